@@ -0,0 +1,764 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "disk_emu.h"
+#include "block_cache.h"
+
+/*One cached block, kept on the LRU list and in a hash chain*/
+typedef struct {
+    int block;
+    int dirty;
+    /*Handle of the async read filling the entry or of the async write */
+    /*of its data, or -1. Entries moved by the same run share a handle  */
+    int pending;
+    int writing;
+    /*Block and buffer lists of that run, owned until it completes*/
+    void *run;
+    /*Views handed out by cache_pin_block, a pinned entry is never evicted*/
+    int pins;
+    int prev, next;
+    int hash_next;
+} cache_entry_t;
+
+static cache_entry_t* entries = NULL;
+static char* cache_data = NULL;
+static int* buckets = NULL;
+static int cache_capacity = 0;
+static int cache_block_size = 0;
+static int bucket_mask = 0;
+static int used = 0;
+/*Most recently used entry at the head, eviction victim at the tail*/
+static int lru_head = -1, lru_tail = -1;
+static int exit_flush_registered = 0;
+/*Process that filled the cache, a forked child must not write its blocks*/
+static pid_t cache_owner = 0;
+/*Guards every entry and list above. Calls take it on entry, the  */
+/*static helpers below expect it held.                           */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int hash_block(int block)
+{
+    return (int)(((unsigned int)block * 2654435761u) & bucket_mask);
+}
+
+static char* entry_data(int e)
+{
+    return cache_data + (size_t)e * cache_block_size;
+}
+
+static void lru_unlink(int e)
+{
+    if (entries[e].prev != -1)
+        entries[entries[e].prev].next = entries[e].next;
+    else
+        lru_head = entries[e].next;
+    if (entries[e].next != -1)
+        entries[entries[e].next].prev = entries[e].prev;
+    else
+        lru_tail = entries[e].prev;
+}
+
+static void lru_push_front(int e)
+{
+    entries[e].prev = -1;
+    entries[e].next = lru_head;
+    if (lru_head != -1)
+        entries[lru_head].prev = e;
+    lru_head = e;
+    if (lru_tail == -1)
+        lru_tail = e;
+}
+
+static int lookup(int block)
+{
+    int e;
+    for (e = buckets[hash_block(block)]; e != -1; e = entries[e].hash_next)
+    {
+        if (entries[e].block == block)
+            return e;
+    }
+    return -1;
+}
+
+static void hash_remove(int e)
+{
+    if (entries[e].block == -1)
+        return;
+
+    int* link = &buckets[hash_block(entries[e].block)];
+    while (*link != e)
+        link = &entries[*link].hash_next;
+    *link = entries[e].hash_next;
+}
+
+/*Marks an entry as just used*/
+static void touch(int e)
+{
+    if (lru_head != e)
+    {
+        lru_unlink(e);
+        lru_push_front(e);
+    }
+}
+
+/*Forgets an entry's block and moves it to the LRU tail to be reused first*/
+static void drop_entry(int e)
+{
+    hash_remove(e);
+    entries[e].block = -1;
+    entries[e].dirty = 0;
+    lru_unlink(e);
+    entries[e].prev = lru_tail;
+    entries[e].next = -1;
+    if (lru_tail != -1)
+        entries[lru_tail].next = e;
+    lru_tail = e;
+    if (lru_head == -1)
+        lru_head = e;
+}
+
+/*-------------------------------------------------------------*/
+/*Waits for the async request moving an entry. A failed read    */
+/*leaves nothing worth keeping and the entry is dropped, after  */
+/*a failed write the entry is dirty again.                      */
+/*-------------------------------------------------------------*/
+static int finish_pending(int e)
+{
+    int i, ok, handle = entries[e].pending;
+    int dropped = !entries[e].writing;
+    void *run = entries[e].run;
+
+    if (handle == -1)
+        return 0;
+    ok = wait_disk_request(handle) >= 0;
+
+    for (i = 0; i < used; i++)
+    {
+        if (entries[i].pending == -1 || entries[i].run != run)
+            continue;
+        entries[i].pending = -1;
+        entries[i].run = NULL;
+        if (!ok && entries[i].writing)
+            entries[i].dirty = 1;
+        else if (!ok)
+            drop_entry(i);
+        entries[i].writing = 0;
+    }
+    free(run);
+    return ok || !dropped ? 0 : -1;
+}
+
+/*---------------------------------------------------------------*/
+/*Returns a free entry for block, evicting the least recently    */
+/*used one and writing it back first if it is dirty              */
+/*---------------------------------------------------------------*/
+static int claim_entry(int block)
+{
+    int e;
+
+    if (used < cache_capacity)
+    {
+        e = used++;
+    }
+    else
+    {
+        /*Least recently used entry that nobody has pinned*/
+        for (e = lru_tail; e != -1 && entries[e].pins > 0; e = entries[e].prev)
+            ;
+        if (e == -1)
+            return -1;
+        finish_pending(e);
+        if (entries[e].dirty && write_blocks(entries[e].block, 1, entry_data(e)) < 0)
+            return -1;
+        lru_unlink(e);
+        hash_remove(e);
+    }
+
+    entries[e].block = block;
+    entries[e].dirty = 0;
+    entries[e].pending = -1;
+    entries[e].writing = 0;
+    entries[e].run = NULL;
+    entries[e].pins = 0;
+    entries[e].hash_next = buckets[hash_block(block)];
+    buckets[hash_block(block)] = e;
+    lru_push_front(e);
+    return e;
+}
+
+static void flush_at_exit()
+{
+    flush_cache();
+}
+
+static int close_entries();
+
+/*Allocates the entries of an empty cache, cache_lock held*/
+static int create_entries(int block_size, int capacity)
+{
+    int i, nbuckets = 1;
+
+    while (nbuckets < 2 * capacity)
+        nbuckets <<= 1;
+
+    entries = malloc(sizeof(cache_entry_t) * capacity);
+    cache_data = malloc((size_t)block_size * capacity);
+    buckets = malloc(sizeof(int) * nbuckets);
+    if (entries == NULL || cache_data == NULL || buckets == NULL)
+    {
+        close_entries();
+        return -1;
+    }
+    for (i = 0; i < nbuckets; i++)
+        buckets[i] = -1;
+
+    cache_capacity = capacity;
+    cache_block_size = block_size;
+    bucket_mask = nbuckets - 1;
+    cache_owner = getpid();
+
+    /*Like stdio, dirty blocks reach the disk when the process exits*/
+    if (!exit_flush_registered)
+    {
+        atexit(flush_at_exit);
+        exit_flush_registered = 1;
+    }
+    return 0;
+}
+
+/*--------------------------------------------------------------*/
+/*Sets up an empty cache of capacity blocks. Dirty blocks of a   */
+/*previous cache are written back first. A capacity of 0 turns   */
+/*caching off and every call goes straight to the disk.          */
+/*--------------------------------------------------------------*/
+int init_cache(int block_size, int capacity)
+{
+    int ret;
+
+    pthread_mutex_lock(&cache_lock);
+    close_entries();
+    ret = capacity <= 0 ? 0 : create_entries(block_size, capacity);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*-------------------------------------------------------------*/
+/*Moves a sorted list of blocks as one async request per run of  */
+/*consecutive blocks, so separate runs (say file data and the    */
+/*i-node block) proceed on different workers at the same time    */
+/*-------------------------------------------------------------*/
+static int transfer_runs(int write, int nblocks, int *blocks, void **buffers)
+{
+    int i, run, nhandles = 0, ret = 0;
+    int *handles = malloc(sizeof(int) * nblocks);
+
+    for (i = 0; i < nblocks; i += run)
+    {
+        for (run = 1; i + run < nblocks && blocks[i + run] == blocks[i] + run; run++)
+            ;
+        if (write)
+            handles[nhandles] = submit_write_block_list(run, blocks + i, buffers + i, NULL, NULL);
+        else
+            handles[nhandles] = submit_read_block_list(run, blocks + i, buffers + i, NULL, NULL);
+        if (handles[nhandles] == -1)
+            ret = -1;
+        else
+            nhandles++;
+    }
+    for (i = 0; i < nhandles; i++)
+    {
+        if (wait_disk_request(handles[i]) < 0)
+            ret = -1;
+    }
+
+    free(handles);
+    return ret;
+}
+
+/*-------------------------------------------------------------*/
+/*Writes every dirty block back, lowest block number first so  */
+/*runs of neighbouring blocks leave as single vectored writes  */
+/*-------------------------------------------------------------*/
+static int compare_blocks(const void* a, const void* b)
+{
+    return entries[*(const int*)a].block - entries[*(const int*)b].block;
+}
+
+static int flush_entries()
+{
+    int i, n = 0, ret = 0;
+    int *dirty, *blocks;
+    void **buffers;
+
+    /*Blocks inherited across fork belong to the parent's view of the disk*/
+    if (entries == NULL || cache_owner != getpid())
+        return 0;
+
+    /*Write-behind still in flight, failed ones come back dirty*/
+    for (i = 0; i < used; i++)
+    {
+        if (entries[i].writing)
+            finish_pending(i);
+    }
+
+    dirty = malloc(sizeof(int) * used);
+    blocks = malloc(sizeof(int) * used);
+    buffers = malloc(sizeof(void*) * used);
+
+    for (i = 0; i < used; i++)
+    {
+        if (entries[i].dirty)
+            dirty[n++] = i;
+    }
+    qsort(dirty, n, sizeof(int), compare_blocks);
+    for (i = 0; i < n; i++)
+    {
+        blocks[i] = entries[dirty[i]].block;
+        buffers[i] = entry_data(dirty[i]);
+    }
+
+    if (n > 0 && transfer_runs(1, n, blocks, buffers) < 0)
+    {
+        ret = -1;
+    }
+    else
+    {
+        for (i = 0; i < n; i++)
+            entries[dirty[i]].dirty = 0;
+    }
+
+    free(dirty);
+    free(blocks);
+    free(buffers);
+    return ret;
+}
+
+int flush_cache()
+{
+    int ret;
+
+    pthread_mutex_lock(&cache_lock);
+    ret = flush_entries();
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*-------------------------------------------------------*/
+/*Writes back dirty blocks and releases the cache memory */
+/*-------------------------------------------------------*/
+static int close_entries()
+{
+    int i, ret;
+
+    /*Workers must be done with the memory before it goes away*/
+    for (i = 0; i < used; i++)
+        finish_pending(i);
+    ret = flush_entries();
+
+    free(entries);
+    free(cache_data);
+    free(buckets);
+    entries = NULL;
+    cache_data = NULL;
+    buckets = NULL;
+    cache_capacity = 0;
+    used = 0;
+    lru_head = lru_tail = -1;
+    return ret;
+}
+
+int close_cache()
+{
+    int ret;
+
+    pthread_mutex_lock(&cache_lock);
+    ret = close_entries();
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*----------------------------------------------------------*/
+/*Reads the listed blocks, serving hits from memory. Misses */
+/*are read together in one list read and then cached. The   */
+/*lock is let go during that read so other threads keep     */
+/*hitting, callers never write a block another thread reads.*/
+/*----------------------------------------------------------*/
+static int read_list(int nblocks, int *block_numbers, void **buffers)
+{
+    int i, e, ret, misses = 0;
+    int *miss_blocks;
+    void **miss_buffers;
+
+    miss_blocks = malloc(sizeof(int) * nblocks);
+    miss_buffers = malloc(sizeof(void*) * nblocks);
+
+    for (i = 0; i < nblocks; i++)
+    {
+        e = lookup(block_numbers[i]);
+        if (e != -1 && finish_pending(e) < 0)
+            e = -1;
+        if (e != -1)
+        {
+            memcpy(buffers[i], entry_data(e), cache_block_size);
+            touch(e);
+        }
+        else
+        {
+            miss_blocks[misses] = block_numbers[i];
+            miss_buffers[misses] = buffers[i];
+            misses++;
+        }
+    }
+
+    ret = 0;
+    if (misses > 0)
+    {
+        pthread_mutex_unlock(&cache_lock);
+        ret = transfer_runs(0, misses, miss_blocks, miss_buffers);
+        pthread_mutex_lock(&cache_lock);
+    }
+    if (ret < 0)
+    {
+        nblocks = -1;
+    }
+    else
+    {
+        for (i = 0; i < misses; i++)
+        {
+            /*Another thread may have cached it meanwhile*/
+            if (entries == NULL || lookup(miss_blocks[i]) != -1)
+                continue;
+            e = claim_entry(miss_blocks[i]);
+            if (e != -1)
+                memcpy(entry_data(e), miss_buffers[i], cache_block_size);
+        }
+    }
+
+    free(miss_blocks);
+    free(miss_buffers);
+    return nblocks;
+}
+
+int cache_read_block_list(int nblocks, int *block_numbers, void **buffers)
+{
+    int ret;
+
+    pthread_mutex_lock(&cache_lock);
+    if (entries == NULL)
+        ret = read_block_list(nblocks, block_numbers, buffers);
+    else
+        ret = read_list(nblocks, block_numbers, buffers);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*---------------------------------------------------------*/
+/*Copies the listed blocks into the cache and marks them   */
+/*dirty. They reach the disk on eviction or flush_cache.   */
+/*---------------------------------------------------------*/
+static int write_list(int nblocks, int *block_numbers, void **buffers)
+{
+    int i, e;
+
+    for (i = 0; i < nblocks; i++)
+    {
+        if (block_numbers[i] < 0)
+            return -1;
+        /*An async read must not land on top of the new data*/
+        e = lookup(block_numbers[i]);
+        if (e != -1 && finish_pending(e) < 0)
+            e = -1;
+        if (e != -1)
+            touch(e);
+        else
+            e = claim_entry(block_numbers[i]);
+
+        /*No entry could be freed, write through*/
+        if (e == -1)
+        {
+            if (write_blocks(block_numbers[i], 1, buffers[i]) < 0)
+                return -1;
+            continue;
+        }
+        memcpy(entry_data(e), buffers[i], cache_block_size);
+        entries[e].dirty = 1;
+    }
+    return nblocks;
+}
+
+int cache_write_block_list(int nblocks, int *block_numbers, void **buffers)
+{
+    int ret;
+
+    pthread_mutex_lock(&cache_lock);
+    if (entries == NULL)
+        ret = write_block_list(nblocks, block_numbers, buffers);
+    else
+        ret = write_list(nblocks, block_numbers, buffers);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*-------------------------------------------------------------------*/
+/*Contiguous versions of the list calls, same interface as disk_emu   */
+/*-------------------------------------------------------------------*/
+static int contiguous(int write, int start_address, int nblocks, void *buffer)
+{
+    int i, ret;
+    int *blocks = malloc(sizeof(int) * nblocks);
+    void **buffers = malloc(sizeof(void*) * nblocks);
+
+    for (i = 0; i < nblocks; i++)
+    {
+        blocks[i] = start_address + i;
+        buffers[i] = (char*)buffer + (size_t)i * cache_block_size;
+    }
+    if (write)
+        ret = write_list(nblocks, blocks, buffers);
+    else
+        ret = read_list(nblocks, blocks, buffers);
+
+    free(blocks);
+    free(buffers);
+    return ret;
+}
+
+int cache_read_blocks(int start_address, int nblocks, void *buffer)
+{
+    int ret;
+
+    pthread_mutex_lock(&cache_lock);
+    if (entries == NULL)
+        ret = read_blocks(start_address, nblocks, buffer);
+    else
+        ret = contiguous(0, start_address, nblocks, buffer);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+int cache_write_blocks(int start_address, int nblocks, void *buffer)
+{
+    int ret;
+
+    pthread_mutex_lock(&cache_lock);
+    if (entries == NULL)
+        ret = write_blocks(start_address, nblocks, buffer);
+    else
+        ret = contiguous(1, start_address, nblocks, buffer);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*------------------------------------------------------------*/
+/*Submits one async request moving a run of entries, every entry*/
+/*of the run waits on the same handle. Entries of a read that    */
+/*could not be submitted are dropped, a write leaves them dirty. */
+/*------------------------------------------------------------*/
+static int start_run(int write, int n, int *blocks, int *claimed, void **buffers)
+{
+    int i, handle;
+    /*The request reads both lists until it completes, give it its own copy*/
+    void **run_buffers = malloc(n * (sizeof(void*) + sizeof(int)));
+    int *run_blocks = (int*)(run_buffers + n);
+
+    memcpy(run_buffers, buffers, n * sizeof(void*));
+    memcpy(run_blocks, blocks, n * sizeof(int));
+    if (write)
+        handle = submit_write_block_list(n, run_blocks, run_buffers, NULL, NULL);
+    else
+        handle = submit_read_block_list(n, run_blocks, run_buffers, NULL, NULL);
+
+    for (i = 0; i < n; i++)
+    {
+        if (handle == -1 && !write)
+            drop_entry(claimed[i]);
+        if (handle == -1)
+            continue;
+        entries[claimed[i]].pending = handle;
+        entries[claimed[i]].writing = write;
+        entries[claimed[i]].run = run_buffers;
+        if (write)
+            entries[claimed[i]].dirty = 0;
+    }
+    if (handle == -1)
+    {
+        free(run_buffers);
+        return -1;
+    }
+    return 0;
+}
+
+/*------------------------------------------------------------*/
+/*Starts async reads of the listed blocks that are not cached  */
+/*yet, one request per run of consecutive blocks. Later reads  */
+/*of those blocks wait for them instead of going to the disk.  */
+/*------------------------------------------------------------*/
+static int prefetch(int nblocks, int *block_numbers)
+{
+    int i, e, n = 0, started = 0;
+    int *blocks, *claimed;
+    void **buffers;
+
+    /*Entries claimed for a run sit at the LRU head, keep them clear of eviction until submitted*/
+    if (nblocks > cache_capacity / 2)
+        nblocks = cache_capacity / 2;
+
+    blocks = malloc(sizeof(int) * nblocks);
+    claimed = malloc(sizeof(int) * nblocks);
+    buffers = malloc(sizeof(void*) * nblocks);
+
+    for (i = 0; i <= nblocks; i++)
+    {
+        /*Submit the run gathered so far once it stops being consecutive*/
+        if (n > 0 && (i == nblocks || block_numbers[i] != blocks[n - 1] + 1))
+        {
+            if (start_run(0, n, blocks, claimed, buffers) < 0)
+                break;
+            started += n;
+            n = 0;
+        }
+        if (i == nblocks)
+            break;
+        if (block_numbers[i] < 0 || lookup(block_numbers[i]) != -1)
+            continue;
+        e = claim_entry(block_numbers[i]);
+        if (e == -1)
+            break;
+        blocks[n] = block_numbers[i];
+        claimed[n] = e;
+        buffers[n] = entry_data(e);
+        n++;
+    }
+
+    free(blocks);
+    free(claimed);
+    free(buffers);
+    return started;
+}
+
+int cache_prefetch(int nblocks, int *block_numbers)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&cache_lock);
+    if (entries != NULL)
+        ret = prefetch(nblocks, block_numbers);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*------------------------------------------------------------*/
+/*Starts writing back the listed dirty blocks in the background,*/
+/*one request per run of consecutive blocks, so a sequential    */
+/*writer's finished blocks leave as a few multi-block writes    */
+/*instead of one block per eviction                             */
+/*------------------------------------------------------------*/
+static int write_behind(int nblocks, int *block_numbers)
+{
+    int i, e, n = 0, started = 0;
+    int *blocks, *claimed;
+    void **buffers;
+
+    blocks = malloc(sizeof(int) * nblocks);
+    claimed = malloc(sizeof(int) * nblocks);
+    buffers = malloc(sizeof(void*) * nblocks);
+
+    for (i = 0; i <= nblocks; i++)
+    {
+        if (n > 0 && (i == nblocks || block_numbers[i] != blocks[n - 1] + 1))
+        {
+            if (start_run(1, n, blocks, claimed, buffers) < 0)
+                break;
+            started += n;
+            n = 0;
+        }
+        if (i == nblocks)
+            break;
+        e = lookup(block_numbers[i]);
+        if (e == -1 || !entries[e].dirty || entries[e].pending != -1)
+            continue;
+        blocks[n] = block_numbers[i];
+        claimed[n] = e;
+        buffers[n] = entry_data(e);
+        n++;
+    }
+
+    free(blocks);
+    free(claimed);
+    free(buffers);
+    return started;
+}
+
+int cache_write_behind(int nblocks, int *block_numbers)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&cache_lock);
+    if (entries != NULL && cache_owner == getpid())
+        ret = write_behind(nblocks, block_numbers);
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+/*--------------------------------------------------------------*/
+/*Returns the cached copy of a block, reading it in on a miss,   */
+/*and pins it so it stays at that address until cache_unpin_block*/
+/*The caller must not write through the pointer. Returns NULL if */
+/*caching is off, every entry is pinned or the read failed.      */
+/*--------------------------------------------------------------*/
+const void* cache_pin_block(int block_number)
+{
+    int e;
+
+    if (block_number < 0)
+        return NULL;
+    pthread_mutex_lock(&cache_lock);
+    if (entries == NULL)
+    {
+        pthread_mutex_unlock(&cache_lock);
+        return NULL;
+    }
+
+    e = lookup(block_number);
+    if (e != -1 && finish_pending(e) < 0)
+        e = -1;
+    if (e == -1)
+    {
+        e = claim_entry(block_number);
+        if (e != -1 && read_blocks(block_number, 1, entry_data(e)) < 0)
+        {
+            drop_entry(e);
+            e = -1;
+        }
+        if (e == -1)
+        {
+            pthread_mutex_unlock(&cache_lock);
+            return NULL;
+        }
+    }
+
+    touch(e);
+    entries[e].pins++;
+    pthread_mutex_unlock(&cache_lock);
+    return entry_data(e);
+}
+
+/*------------------------------------------------------*/
+/*Releases one pin taken by cache_pin_block on a block  */
+/*------------------------------------------------------*/
+int cache_unpin_block(int block_number)
+{
+    int e, ret = -1;
+
+    pthread_mutex_lock(&cache_lock);
+    e = entries == NULL ? -1 : lookup(block_number);
+    if (e != -1 && entries[e].pins > 0)
+    {
+        entries[e].pins--;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
@@ -0,0 +1,13 @@
+/*Write-back block cache sitting between the file system and the disk emulator*/
+
+int init_cache(int block_size, int capacity);
+int cache_read_blocks(int start_address, int nblocks, void *buffer);
+int cache_write_blocks(int start_address, int nblocks, void *buffer);
+int cache_read_block_list(int nblocks, int *block_numbers, void **buffers);
+int cache_write_block_list(int nblocks, int *block_numbers, void **buffers);
+int cache_prefetch(int nblocks, int *block_numbers);
+int cache_write_behind(int nblocks, int *block_numbers);
+const void* cache_pin_block(int block_number);
+int cache_unpin_block(int block_number);
+int flush_cache();
+int close_cache();
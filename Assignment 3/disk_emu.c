@@ -1,24 +1,315 @@
 #include <stdio.h>
 #include <stdlib.h> 
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
 #include "disk_emu.h"
 
 
 FILE* fp = NULL;
-double L, p;
-double r;
-int BLOCK_SIZE, MAX_BLOCK, MAX_RETRY, lru;
+int BLOCK_SIZE, MAX_BLOCK;
+
+/*Device model applied to every operation and the counters it feeds.*/
+/*The default model is an ideal disk: no delay and no failures.      */
+disk_model_t model = {0, 0, 0, 0, 3, 0};
+disk_stats_t stats;
+/*Block under the head once the last operation finished*/
+int head = 0;
+unsigned int failure_seed = 1;
+/*Operations may come from the async workers, the model state is shared*/
+pthread_mutex_t model_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*Backend used by the next init_disk/init_fresh_disk and the mapping it produced*/
+int backend = DISK_BACKEND_FILE;
+char* disk_map = NULL;
+size_t disk_map_length = 0;
+/*How init_fresh_disk provides the zeroed blocks of a new disk*/
+int fresh_allocation = DISK_ALLOC_SPARSE;
+
+/*-------------------------------------------------------------*/
+/*Replaces the device model, it applies from the next operation */
+/*-------------------------------------------------------------*/
+int set_disk_model(disk_model_t *disk_model)
+{
+    if (disk_model->latency < 0 || disk_model->seek_cost < 0 ||
+        disk_model->bandwidth < 0 || disk_model->max_retry < 0)
+    {
+        return -1;
+    }
+    pthread_mutex_lock(&model_lock);
+    model = *disk_model;
+    pthread_mutex_unlock(&model_lock);
+    return 0;
+}
+
+/*----------------------------------------------*/
+/*Copies the device model currently in effect    */
+/*----------------------------------------------*/
+int get_disk_model(disk_model_t *disk_model)
+{
+    pthread_mutex_lock(&model_lock);
+    *disk_model = model;
+    pthread_mutex_unlock(&model_lock);
+    return 0;
+}
+
+/*----------------------------------------------*/
+/*Copies the counters gathered since the reset  */
+/*----------------------------------------------*/
+int get_disk_stats(disk_stats_t *disk_stats)
+{
+    pthread_mutex_lock(&model_lock);
+    *disk_stats = stats;
+    pthread_mutex_unlock(&model_lock);
+    return 0;
+}
+
+/*----------------------------------------------*/
+/*Clears every counter                          */
+/*----------------------------------------------*/
+void reset_disk_stats()
+{
+    pthread_mutex_lock(&model_lock);
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_unlock(&model_lock);
+}
+
+/*----------------------------------------------*/
+/*Prints every counter to out                   */
+/*----------------------------------------------*/
+void dump_disk_stats(FILE *out)
+{
+    disk_stats_t copy;
+
+    /*printed from a copy, the workers keep counting meanwhile*/
+    get_disk_stats(&copy);
+    fprintf(out, "reads           %ld (%ld blocks, %ld bytes)\n", copy.reads, copy.blocks_read, copy.bytes_read);
+    fprintf(out, "writes          %ld (%ld blocks, %ld bytes)\n", copy.writes, copy.blocks_written, copy.bytes_written);
+    fprintf(out, "seeks           %ld (%ld blocks travelled)\n", copy.seeks, copy.seek_distance);
+    fprintf(out, "retries         %ld\n", copy.retries);
+    fprintf(out, "failures        %ld\n", copy.failures);
+    fprintf(out, "simulated time  %.0f us\n", copy.simulated_time);
+}
+
+/*Sleeps for a modelled number of microseconds*/
+static void pause_for(double microseconds)
+{
+    struct timespec t;
+    t.tv_sec = (time_t)(microseconds / 1000000);
+    t.tv_nsec = (long)((microseconds - t.tv_sec * 1000000.0) * 1000);
+    while (nanosleep(&t, &t) < 0 && errno == EINTR)
+        ;
+}
+
+/*-------------------------------------------------------------------*/
+/*Runs one operation on nblocks contiguous blocks through the device */
+/*model: charges latency, seek and transfer time, injects failures   */
+/*and retries them. Returns -1 when every retry failed.              */
+/*-------------------------------------------------------------------*/
+static int model_access(int write, int start_address, int nblocks)
+{
+    int attempt, distance;
+    long bytes = (long)nblocks * BLOCK_SIZE;
+    double cost;
+
+    pthread_mutex_lock(&model_lock);
+    distance = start_address > head ? start_address - head : head - start_address;
+    cost = model.latency + model.seek_cost * distance;
+
+    if (model.bandwidth > 0)
+        cost += bytes / model.bandwidth;
+
+    if (write)
+    {
+        stats.writes++;
+        stats.blocks_written += nblocks;
+        stats.bytes_written += bytes;
+    }
+    else
+    {
+        stats.reads++;
+        stats.blocks_read += nblocks;
+        stats.bytes_read += bytes;
+    }
+    if (distance > 0)
+    {
+        stats.seeks++;
+        stats.seek_distance += distance;
+    }
+
+    /*Every failed attempt costs a full operation before the retry*/
+    for (attempt = 0; model.failure > 0 && rand_r(&failure_seed) < model.failure * ((double)RAND_MAX + 1); attempt++)
+    {
+        stats.simulated_time += cost;
+        if (model.emulate_delay)
+            pause_for(cost);
+        if (attempt == model.max_retry)
+        {
+            stats.failures++;
+            pthread_mutex_unlock(&model_lock);
+            return -1;
+        }
+        stats.retries++;
+        /*The head is back where the operation started*/
+        cost = model.latency + model.seek_cost * nblocks;
+        if (model.bandwidth > 0)
+            cost += bytes / model.bandwidth;
+    }
+
+    stats.simulated_time += cost;
+    if (model.emulate_delay)
+        pause_for(cost);
+    head = start_address + nblocks;
+    pthread_mutex_unlock(&model_lock);
+    return 0;
+}
+
+/*------------------------------------------------------------*/
+/*Selects the backend used by the next init_disk/init_fresh_disk*/
+/*------------------------------------------------------------*/
+int set_disk_backend(int disk_backend)
+{
+    if (disk_backend != DISK_BACKEND_FILE && disk_backend != DISK_BACKEND_MMAP)
+    {
+        return -1;
+    }
+    backend = disk_backend;
+    return 0;
+}
+
+/*----------------------------------------------------------------*/
+/*Selects how init_fresh_disk lays out new disks: sparse, reserved */
+/*with fallocate, or explicitly written with zeros                 */
+/*----------------------------------------------------------------*/
+int set_fresh_disk_allocation(int allocation)
+{
+    if (allocation != DISK_ALLOC_SPARSE && allocation != DISK_ALLOC_RESERVE && allocation != DISK_ALLOC_ZERO)
+    {
+        return -1;
+    }
+    fresh_allocation = allocation;
+    return 0;
+}
+
+/*-------------------------------------------------------------*/
+/*Gives the empty disk file its full size of zeroed blocks      */
+/*-------------------------------------------------------------*/
+static int allocate_disk(off_t length)
+{
+    int fd = fileno(fp);
+    off_t done;
+    ssize_t n;
+    char* zeros;
+
+    /*Sparse: the file system hands back zeros for blocks never written*/
+    if (ftruncate(fd, length) < 0)
+        return -1;
+
+    if (fresh_allocation == DISK_ALLOC_RESERVE)
+    {
+        /*Reserve the space up front, still without writing it*/
+        if (posix_fallocate(fd, 0, length) == 0)
+            return 0;
+        /*No fallocate support here, write the zeros instead*/
+    }
+    else if (fresh_allocation == DISK_ALLOC_SPARSE)
+    {
+        return 0;
+    }
+
+    zeros = calloc(1, DISK_ZERO_CHUNK);
+    if (zeros == NULL)
+        return -1;
+    for (done = 0; done < length; done += n)
+    {
+        n = pwrite(fd, zeros, length - done < DISK_ZERO_CHUNK ? length - done : DISK_ZERO_CHUNK, done);
+        if (n < 0 && errno == EINTR)
+        {
+            n = 0;
+            continue;
+        }
+        if (n <= 0)
+        {
+            free(zeros);
+            return -1;
+        }
+    }
+    free(zeros);
+    return 0;
+}
+
+/*-------------------------------------------------------------*/
+/*Maps the whole opened disk file, growing it if it is too short*/
+/*-------------------------------------------------------------*/
+static int map_disk()
+{
+    struct stat st;
+    int fd = fileno(fp);
+
+    disk_map_length = (size_t)BLOCK_SIZE * MAX_BLOCK;
+
+    if (fstat(fd, &st) < 0)
+    {
+        return -1;
+    }
+    /*Mapping past the end of the file would fault on access*/
+    if ((size_t)st.st_size < disk_map_length && ftruncate(fd, disk_map_length) < 0)
+    {
+        return -1;
+    }
+
+    disk_map = mmap(NULL, disk_map_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (disk_map == MAP_FAILED)
+    {
+        disk_map = NULL;
+        printf("Could not map disk file, falling back to file I/O\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*-------------------------------------------------------------------*/
+/*Flushes every block written so far to stable storage               */
+/*-------------------------------------------------------------------*/
+int sync_disk()
+{
+    if (NULL != disk_map)
+    {
+        return msync(disk_map, disk_map_length, MS_SYNC);
+    }
+    if (NULL != fp)
+    {
+        fflush(fp);
+        return fsync(fileno(fp));
+    }
+    return 0;
+}
 
 /*----------------------------------------------------------*/
 /*Close the disk file filled when you don't need it anymore. */
 /*----------------------------------------------------------*/
 int close_disk()
 {
+    /*Outstanding async requests still use the file*/
+    wait_all_disk_requests();
+
+    if(NULL != disk_map)
+    {
+        msync(disk_map, disk_map_length, MS_SYNC);
+        munmap(disk_map, disk_map_length);
+        disk_map = NULL;
+    }
     if(NULL != fp)
     {
         fclose(fp);
+        fp = NULL;
     }
     return 0;
 }
@@ -28,20 +319,15 @@ int close_disk()
 /*---------------------------------------*/
 int init_fresh_disk(char *filename, int block_size, int num_blocks)
 {
-    int i, j;
-    
-    /*Set up latency at 0.02 second*/
-    L = 00000.f;
-    /*Set up failure at 10%*/
-    p = -1.f;
-    /*Set up max retry attempts after failure to 3*/
-    MAX_RETRY = 3;
+    /*Release a disk left open by a previous init*/
+    close_disk();
 
     BLOCK_SIZE = block_size;
     MAX_BLOCK = num_blocks;
     
-    /*Initializes the random number generator*/
-    srand((unsigned int)(time( 0 )) );
+    /*Initializes the failure generator and parks the head*/
+    failure_seed = (unsigned int)(time( 0 ));
+    head = 0;
     /*Creates a new file*/
     fp = fopen (filename, "w+b");
 
@@ -51,13 +337,18 @@ int init_fresh_disk(char *filename, int block_size, int num_blocks)
         return -1;
     }
     
-    /*Fills the file with 0's to its given size*/
-    for (i = 0; i < MAX_BLOCK; i++)
+    /*Gives the file its size, every block reads back as 0's*/
+    if (allocate_disk((off_t)MAX_BLOCK * BLOCK_SIZE) < 0)
     {
-        for (j = 0; j < BLOCK_SIZE; j++)
-        {
-            fputc(0, fp);
-        }
+        printf("Could not allocate disk file %s\n\n", filename);
+        fclose(fp);
+        fp = NULL;
+        return -1;
+    }
+
+    if (backend == DISK_BACKEND_MMAP)
+    {
+        map_disk();
     }
     return 0;
 }
@@ -66,18 +357,15 @@ int init_fresh_disk(char *filename, int block_size, int num_blocks)
 /*----------------------------*/
 int init_disk(char *filename, int block_size, int num_blocks)
 {
-    /*Set up latency at 0.02 second*/
-    L = 00000.f;
-    /*Set up failure at 10%*/
-    p = -1.f;
-    /*Set up max retry attempts after failure to 3*/
-    MAX_RETRY = 3;
+    /*Release a disk left open by a previous init*/
+    close_disk();
 
     BLOCK_SIZE = block_size;
     MAX_BLOCK = num_blocks;
     
-    /*Initializes the random number generator*/
-    srand((unsigned int)(time( 0 )) );
+    /*Initializes the failure generator and parks the head*/
+    failure_seed = (unsigned int)(time( 0 ));
+    head = 0;
     
     /*Opens a file*/
     fp = fopen (filename, "r+b");
@@ -87,6 +375,50 @@ int init_disk(char *filename, int block_size, int num_blocks)
         printf("Could not open %s\n\n", filename);
         return -1;
     }
+
+    if (backend == DISK_BACKEND_MMAP)
+    {
+        map_disk();
+    }
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+/*Moves a run of contiguous blocks between the disk file and the iovecs*/
+/*with positioned vectored I/O, resuming after short transfers          */
+/*--------------------------------------------------------------------*/
+static int transfer_blocks(int write, int start_address, struct iovec *iov, int iovcnt)
+{
+    int fd = fileno(fp);
+    off_t offset = (off_t)start_address * BLOCK_SIZE;
+    ssize_t done;
+
+    while (iovcnt > 0)
+    {
+        if (write)
+            done = pwritev(fd, iov, iovcnt, offset);
+        else
+            done = preadv(fd, iov, iovcnt, offset);
+
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0)
+            return -1;
+
+        offset += done;
+        /*Skip the iovecs that completed and trim the one left partial*/
+        while (iovcnt > 0 && (size_t)done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
     return 0;
 }
 
@@ -95,86 +427,450 @@ int init_disk(char *filename, int block_size, int num_blocks)
 /*-------------------------------------------------------------------*/
 int read_blocks(int start_address, int nblocks, void *buffer)
 {
-    int i, j, e, s;
-    e = 0;
-    s = 0;
-
-    /*Sets up a temporary buffer*/
-    void* blockRead = (void*) malloc(BLOCK_SIZE);
+    struct iovec iov;
 
     /*Checks that the data requested is within the range of addresses of the disk*/
-    if (start_address + nblocks > MAX_BLOCK)
+    if (start_address < 0 || nblocks < 0 || start_address + nblocks > MAX_BLOCK)
     {
         printf("out of bound error %d\n", start_address);
         return -1;
     }
 
-    /*Goto the data requested from the disk*/
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
+    if (model_access(0, start_address, nblocks) < 0)
+    {
+        printf("read failed at block %d\n", start_address);
+        return -1;
+    }
+
+    /*Mapped disk: copy straight out of the mapping*/
+    if (NULL != disk_map)
+    {
+        memcpy(buffer, disk_map + (size_t)start_address * BLOCK_SIZE, (size_t)nblocks * BLOCK_SIZE);
+        return nblocks;
+    }
+
+    /*One positioned read of every block straight into the caller's buffer*/
+    iov.iov_base = buffer;
+    iov.iov_len = (size_t)nblocks * BLOCK_SIZE;
+    if (nblocks > 0 && transfer_blocks(0, start_address, &iov, 1) < 0)
+    {
+        printf("read error at block %d\n", start_address);
+        return -1;
+    }
+
+    return nblocks;
+}
+
+/*------------------------------------------------------------------*/
+/*Writes a series of blocks to the disk from the buffer             */
+/*------------------------------------------------------------------*/
+int write_blocks(int start_address, int nblocks, void *buffer)
+{
+    struct iovec iov;
+
+    /*Checks that the data requested is within the range of addresses of the disk*/
+    if (start_address < 0 || nblocks < 0 || start_address + nblocks > MAX_BLOCK)
+    {
+        printf("out of bound error\n");
+        return -1;
+    }
+
+    if (model_access(1, start_address, nblocks) < 0)
+    {
+        printf("write failed at block %d\n", start_address);
+        return -1;
+    }
+
+    /*Mapped disk: copy straight into the mapping, sync_disk makes it durable*/
+    if (NULL != disk_map)
+    {
+        memcpy(disk_map + (size_t)start_address * BLOCK_SIZE, buffer, (size_t)nblocks * BLOCK_SIZE);
+        return nblocks;
+    }
 
-    /*For every block requested*/
-    for (i = 0; i < nblocks; ++i)
+    /*One positioned write of every block, sync_disk makes it durable*/
+    iov.iov_base = buffer;
+    iov.iov_len = (size_t)nblocks * BLOCK_SIZE;
+    if (nblocks > 0 && transfer_blocks(1, start_address, &iov, 1) < 0)
     {
-        /*Pause until the latency duration is elapsed*/
-        // usleep(L);
+        printf("write error at block %d\n", start_address);
+        return -1;
+    }
 
-        s++;
-        fread(blockRead, BLOCK_SIZE, 1, fp);
+    return nblocks;
+}
+
+/*------------------------------------------------------------------*/
+/*Scatter/gather transfer of a list of blocks, each with its own     */
+/*buffer. Runs of consecutive block numbers go out as one vectored   */
+/*call.                                                              */
+/*------------------------------------------------------------------*/
+static int transfer_block_list(int write, int nblocks, int *block_numbers, void **buffers)
+{
+    struct iovec iov[DISK_IOV_BATCH];
+    int i, j, run;
 
-       for (j = 0; j < BLOCK_SIZE; j++)
+    for (i = 0; i < nblocks; i++)
+    {
+        if (block_numbers[i] < 0 || block_numbers[i] >= MAX_BLOCK)
         {
-            memcpy(buffer+(i*BLOCK_SIZE), blockRead, BLOCK_SIZE);  
+            printf("out of bound error %d\n", block_numbers[i]);
+            return -1;
         }
     }
 
-    free(blockRead);
+    for (i = 0; i < nblocks; i += run)
+    {
+        /*Collect the run of consecutive blocks starting at i*/
+        for (run = 0; run < DISK_IOV_BATCH && i + run < nblocks; run++)
+        {
+            if (run > 0 && block_numbers[i + run] != block_numbers[i] + run)
+                break;
+            iov[run].iov_base = buffers[i + run];
+            iov[run].iov_len = BLOCK_SIZE;
+        }
 
+        if (model_access(write, block_numbers[i], run) < 0)
+        {
+            printf("%s failed at block %d\n", write ? "write" : "read", block_numbers[i]);
+            return -1;
+        }
 
-    /*If no failure return the number of blocks read, else return the negative number of failures*/
-    if (e == 0)
-        return s;
-    else
-        return e;
+        /*Mapped disk: every block of the run is a plain copy*/
+        if (NULL != disk_map)
+        {
+            for (j = 0; j < run; j++)
+            {
+                char* block = disk_map + (size_t)(block_numbers[i] + j) * BLOCK_SIZE;
+                if (write)
+                    memcpy(block, buffers[i + j], BLOCK_SIZE);
+                else
+                    memcpy(buffers[i + j], block, BLOCK_SIZE);
+            }
+            continue;
+        }
+
+        if (transfer_blocks(write, block_numbers[i], iov, run) < 0)
+        {
+            printf("%s error at block %d\n", write ? "write" : "read", block_numbers[i]);
+            return -1;
+        }
+    }
+    return nblocks;
 }
 
 /*------------------------------------------------------------------*/
-/*Writes a series of blocks to the disk from the buffer             */
+/*Reads the listed blocks, block_numbers[i] into buffers[i]          */
 /*------------------------------------------------------------------*/
-int write_blocks(int start_address, int nblocks, void *buffer)
+int read_block_list(int nblocks, int *block_numbers, void **buffers)
 {
-    int i, e, s;
-    e = 0;
-    s = 0;
+    return transfer_block_list(0, nblocks, block_numbers, buffers);
+}
 
-    void* blockWrite = (void*) malloc(BLOCK_SIZE);
+/*------------------------------------------------------------------*/
+/*Writes the listed blocks, buffers[i] into block_numbers[i]         */
+/*------------------------------------------------------------------*/
+int write_block_list(int nblocks, int *block_numbers, void **buffers)
+{
+    return transfer_block_list(1, nblocks, block_numbers, buffers);
+}
 
-    /*Checks that the data requested is within the range of addresses of the disk*/
-    if (start_address + nblocks > MAX_BLOCK)
+/*------------------------------------------------------------------*/
+/*Asynchronous requests. Submitted block ranges are queued and       */
+/*serviced by a pool of worker threads that call read_blocks and     */
+/*write_blocks. A handle carries the slot of the request and its     */
+/*generation, so a handle whose slot was reused reads as completed.  */
+/*------------------------------------------------------------------*/
+typedef struct {
+    int state;
+    int generation;
+    int write;
+    int start_address;
+    int nblocks;
+    void* buffer;
+    int* block_numbers;
+    void** buffers;
+    int result;
+    disk_callback_t callback;
+    void* arg;
+    int next;
+} disk_request_t;
+
+#define REQUEST_FREE 0
+#define REQUEST_QUEUED 1
+#define REQUEST_RUNNING 2
+#define REQUEST_DONE 3
+
+/*Generations wrap before slot + generation * DISK_MAX_REQUESTS overflows*/
+#define next_generation(g) (((g) + 1) % (INT_MAX / DISK_MAX_REQUESTS))
+
+disk_request_t requests[DISK_MAX_REQUESTS];
+int queue_head = -1, queue_tail = -1;
+int outstanding = 0;
+int workers = 0;
+int atfork_registered = 0;
+pthread_t worker_threads[DISK_MAX_WORKERS];
+pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+/*Signalled when a request is queued, and when one completes*/
+pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+pthread_cond_t request_done = PTHREAD_COND_INITIALIZER;
+
+static void* disk_worker(void* unused)
+{
+    disk_request_t* req;
+    int slot, result;
+
+    pthread_mutex_lock(&queue_lock);
+    for (;;)
     {
-        printf("out of bound error\n");
-        return -1;
+        while (queue_head == -1)
+            pthread_cond_wait(&queue_ready, &queue_lock);
+
+        slot = queue_head;
+        req = &requests[slot];
+        queue_head = req->next;
+        if (queue_head == -1)
+            queue_tail = -1;
+        req->state = REQUEST_RUNNING;
+        pthread_mutex_unlock(&queue_lock);
+
+        if (req->block_numbers != NULL)
+            result = transfer_block_list(req->write, req->nblocks, req->block_numbers, req->buffers);
+        else if (req->write)
+            result = write_blocks(req->start_address, req->nblocks, req->buffer);
+        else
+            result = read_blocks(req->start_address, req->nblocks, req->buffer);
+
+        if (req->callback != NULL)
+            req->callback(slot + req->generation * DISK_MAX_REQUESTS, result, req->arg);
+
+        pthread_mutex_lock(&queue_lock);
+        req->result = result;
+        outstanding--;
+        /*Nobody waits on a request that reported through its callback*/
+        if (req->callback != NULL)
+        {
+            req->state = REQUEST_FREE;
+            req->generation = next_generation(req->generation);
+        }
+        else
+        {
+            req->state = REQUEST_DONE;
+        }
+        pthread_cond_broadcast(&request_done);
+    }
+    return unused;
+}
+
+/*Threads do not survive fork, the child starts with an empty pool*/
+static void atfork_prepare()
+{
+    pthread_mutex_lock(&queue_lock);
+    pthread_mutex_lock(&model_lock);
+}
+
+static void atfork_parent()
+{
+    pthread_mutex_unlock(&model_lock);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static void atfork_child()
+{
+    int i;
+    for (i = 0; i < DISK_MAX_REQUESTS; i++)
+    {
+        if (requests[i].state != REQUEST_FREE)
+        {
+            requests[i].state = REQUEST_FREE;
+            requests[i].generation = next_generation(requests[i].generation);
+        }
     }
+    queue_head = queue_tail = -1;
+    outstanding = 0;
+    workers = 0;
+    /*The parent's idle workers would still count as waiters*/
+    pthread_cond_init(&queue_ready, NULL);
+    pthread_cond_init(&request_done, NULL);
+    pthread_mutex_unlock(&model_lock);
+    pthread_mutex_unlock(&queue_lock);
+}
 
-    /*Goto where the data is to be written on the disk*/        
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
+/*-----------------------------------------------------------------*/
+/*Starts nthreads workers, or tops the pool up to nthreads. Called  */
+/*with DISK_DEFAULT_WORKERS on the first submit when never called.  */
+/*-----------------------------------------------------------------*/
+int start_disk_workers(int nthreads)
+{
+    if (nthreads > DISK_MAX_WORKERS)
+        nthreads = DISK_MAX_WORKERS;
 
-    /*For every block requested*/        
-    for (i = 0; i < nblocks; ++i)
+    pthread_mutex_lock(&queue_lock);
+    if (!atfork_registered)
     {
-        /*Pause until the latency duration is elapsed*/
-        usleep(L);
+        pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+        atfork_registered = 1;
+    }
+    while (workers < nthreads)
+    {
+        if (pthread_create(&worker_threads[workers], NULL, disk_worker, NULL) != 0)
+            break;
+        pthread_detach(worker_threads[workers]);
+        workers++;
+    }
+    nthreads = workers;
+    pthread_mutex_unlock(&queue_lock);
+    return nthreads;
+}
 
-        memcpy(blockWrite, buffer+(i*BLOCK_SIZE), BLOCK_SIZE);
+static int submit(int write, int start_address, int nblocks, void *buffer,
+                  int *block_numbers, void **buffers, disk_callback_t callback, void *arg)
+{
+    int slot, result, handle;
 
-        fwrite(blockWrite, BLOCK_SIZE, 1, fp);
-        fflush(fp);
-        s++;
+    if (workers == 0 && start_disk_workers(DISK_DEFAULT_WORKERS) == 0)
+    {
+        /*No thread could be started, complete the request right here*/
+        if (block_numbers != NULL)
+            result = transfer_block_list(write, nblocks, block_numbers, buffers);
+        else if (write)
+            result = write_blocks(start_address, nblocks, buffer);
+        else
+            result = read_blocks(start_address, nblocks, buffer);
+        if (callback != NULL)
+            callback(-1, result, arg);
+        return result < 0 ? -1 : DISK_REQUEST_DONE;
     }
-    free(blockWrite);
 
-    /*If no failure return the number of blocks written, else return the negative number of failures*/
-    if (e == 0)
-        return s;
+    pthread_mutex_lock(&queue_lock);
+    for (;;)
+    {
+        for (slot = 0; slot < DISK_MAX_REQUESTS; slot++)
+        {
+            if (requests[slot].state == REQUEST_FREE)
+                break;
+        }
+        if (slot < DISK_MAX_REQUESTS)
+            break;
+        /*Every slot is taken, wait for one to complete*/
+        pthread_cond_wait(&request_done, &queue_lock);
+    }
+
+    requests[slot].state = REQUEST_QUEUED;
+    requests[slot].write = write;
+    requests[slot].start_address = start_address;
+    requests[slot].nblocks = nblocks;
+    requests[slot].buffer = buffer;
+    requests[slot].block_numbers = block_numbers;
+    requests[slot].buffers = buffers;
+    requests[slot].callback = callback;
+    requests[slot].arg = arg;
+    requests[slot].next = -1;
+    if (queue_tail == -1)
+        queue_head = slot;
     else
-        return e;
+        requests[queue_tail].next = slot;
+    queue_tail = slot;
+    outstanding++;
+    /*A request with a callback may be released as soon as the lock is dropped*/
+    handle = slot + requests[slot].generation * DISK_MAX_REQUESTS;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+
+    return handle;
+}
+
+/*-----------------------------------------------------------------*/
+/*Queues a read of nblocks blocks into buffer. Returns a handle for */
+/*poll_disk_request/wait_disk_request. When a callback is given it  */
+/*runs on the worker once the read finished and the request is      */
+/*released by itself.                                               */
+/*-----------------------------------------------------------------*/
+int submit_read_blocks(int start_address, int nblocks, void *buffer, disk_callback_t callback, void *arg)
+{
+    return submit(0, start_address, nblocks, buffer, NULL, NULL, callback, arg);
+}
+
+/*-----------------------------------------------------------------*/
+/*Queues a write of nblocks blocks from buffer, same rules as       */
+/*submit_read_blocks. buffer must stay untouched until completion.  */
+/*-----------------------------------------------------------------*/
+int submit_write_blocks(int start_address, int nblocks, void *buffer, disk_callback_t callback, void *arg)
+{
+    return submit(1, start_address, nblocks, buffer, NULL, NULL, callback, arg);
+}
+
+/*-----------------------------------------------------------------*/
+/*Queues a scatter/gather read, see read_block_list. Both arrays    */
+/*must stay valid until completion.                                 */
+/*-----------------------------------------------------------------*/
+int submit_read_block_list(int nblocks, int *block_numbers, void **buffers, disk_callback_t callback, void *arg)
+{
+    return submit(0, 0, nblocks, NULL, block_numbers, buffers, callback, arg);
+}
+
+/*-----------------------------------------------------------------*/
+/*Queues a scatter/gather write, see write_block_list. Both arrays  */
+/*and the buffers must stay untouched until completion.             */
+/*-----------------------------------------------------------------*/
+int submit_write_block_list(int nblocks, int *block_numbers, void **buffers, disk_callback_t callback, void *arg)
+{
+    return submit(1, 0, nblocks, NULL, block_numbers, buffers, callback, arg);
+}
+
+/*-------------------------------------------------------------*/
+/*Returns 1 when the request completed, 0 while it is pending   */
+/*-------------------------------------------------------------*/
+int poll_disk_request(int handle)
+{
+    int slot = handle % DISK_MAX_REQUESTS;
+    int done;
+
+    if (handle < 0)
+        return handle == DISK_REQUEST_DONE ? 1 : -1;
+
+    pthread_mutex_lock(&queue_lock);
+    done = requests[slot].generation != handle / DISK_MAX_REQUESTS || requests[slot].state == REQUEST_DONE;
+    pthread_mutex_unlock(&queue_lock);
+    return done;
+}
+
+/*--------------------------------------------------------------*/
+/*Blocks until the request completed, releases it and returns    */
+/*what read_blocks/write_blocks returned for it                  */
+/*--------------------------------------------------------------*/
+int wait_disk_request(int handle)
+{
+    int slot = handle % DISK_MAX_REQUESTS;
+    int generation = handle / DISK_MAX_REQUESTS;
+    int result = 0;
+
+    if (handle < 0)
+        return handle == DISK_REQUEST_DONE ? 0 : -1;
+
+    pthread_mutex_lock(&queue_lock);
+    while (requests[slot].generation == generation && requests[slot].state != REQUEST_DONE)
+        pthread_cond_wait(&request_done, &queue_lock);
+
+    if (requests[slot].generation == generation)
+    {
+        result = requests[slot].result;
+        requests[slot].state = REQUEST_FREE;
+        requests[slot].generation = next_generation(requests[slot].generation);
+        pthread_cond_broadcast(&request_done);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return result;
+}
+
+/*-------------------------------------------------------------*/
+/*Blocks until no submitted request is queued or running        */
+/*-------------------------------------------------------------*/
+int wait_all_disk_requests()
+{
+    pthread_mutex_lock(&queue_lock);
+    while (outstanding > 0)
+        pthread_cond_wait(&request_done, &queue_lock);
+    pthread_mutex_unlock(&queue_lock);
+    return 0;
 }
@@ -1,5 +1,73 @@
+#ifndef DISK_EMU_H
+#define DISK_EMU_H
+
+#include <stdio.h>
+
+#define DISK_BACKEND_FILE 0
+#define DISK_BACKEND_MMAP 1
+
+/*How init_fresh_disk provides the zeroed blocks of a new disk*/
+#define DISK_ALLOC_SPARSE 0
+#define DISK_ALLOC_RESERVE 1
+#define DISK_ALLOC_ZERO 2
+/*Bytes per write when zeroing a new disk explicitly*/
+#define DISK_ZERO_CHUNK (1 << 20)
+
+/*Most iovecs handed to one preadv/pwritev call*/
+#define DISK_IOV_BATCH 64
+
+/*Async requests in flight at once, and the worker pool servicing them*/
+#define DISK_MAX_REQUESTS 256
+#define DISK_MAX_WORKERS 16
+#define DISK_DEFAULT_WORKERS 4
+/*Handle of a request that completed before submit returned*/
+#define DISK_REQUEST_DONE -2
+
+/*Called on the worker with the request's handle and its result*/
+typedef void (*disk_callback_t)(int handle, int result, void *arg);
+
+/*Device model, times are in microseconds*/
+typedef struct {
+    double latency;     /*fixed cost of every operation*/
+    double seek_cost;   /*cost per block between the head and the first block*/
+    double bandwidth;   /*bytes transferred per microsecond, 0 for unlimited*/
+    double failure;     /*probability an attempt fails, 0 for never*/
+    int max_retry;      /*retries of a failed attempt before giving up*/
+    int emulate_delay;  /*sleep for the modelled time instead of only counting it*/
+} disk_model_t;
+
+/*Counters gathered by every operation since the last reset*/
+typedef struct {
+    long reads, writes;
+    long blocks_read, blocks_written;
+    long bytes_read, bytes_written;
+    long seeks, seek_distance;
+    long retries, failures;
+    double simulated_time;
+} disk_stats_t;
+
 int init_fresh_disk(char *filename, int block_size, int num_blocks);
 int init_disk(char *filename, int block_size, int num_blocks);
 int read_blocks(int start_address, int nblocks, void *buffer);
 int write_blocks(int start_address, int nblocks, void *buffer);
 int close_disk();
+int set_disk_backend(int disk_backend);
+int sync_disk();
+int set_fresh_disk_allocation(int allocation);
+int read_block_list(int nblocks, int *block_numbers, void **buffers);
+int write_block_list(int nblocks, int *block_numbers, void **buffers);
+int set_disk_model(disk_model_t *disk_model);
+int get_disk_model(disk_model_t *disk_model);
+int get_disk_stats(disk_stats_t *disk_stats);
+void reset_disk_stats();
+void dump_disk_stats(FILE *out);
+int start_disk_workers(int nthreads);
+int submit_read_blocks(int start_address, int nblocks, void *buffer, disk_callback_t callback, void *arg);
+int submit_write_blocks(int start_address, int nblocks, void *buffer, disk_callback_t callback, void *arg);
+int submit_read_block_list(int nblocks, int *block_numbers, void **buffers, disk_callback_t callback, void *arg);
+int submit_write_block_list(int nblocks, int *block_numbers, void **buffers, disk_callback_t callback, void *arg);
+int poll_disk_request(int handle);
+int wait_disk_request(int handle);
+int wait_all_disk_requests();
+
+#endif
@@ -4,891 +4,3669 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
 #include <math.h>
 #include <unistd.h>
+#include <stddef.h>
 #include "disk_emu.h"
+#include "block_cache.h"
 
 #include <sys/types.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 superblock_t sb;
-block_t fbm;
+unsigned char* fbm = NULL;
+// i-node bit map, a set bit is a free i-node like in the free bit map
+unsigned char* ibm = NULL;
 
-fileDescriptor_t fdt[numberOfInodes];
-inodeBlock_t inodeBlocks[13];
-rootDirectory_t rootDirectory[4];
-block_t writeBlock; 
+// tables sized from the geometry in the super block when the disk is made or mounted,
+// the descriptor table has maxOpenFiles entries on every disk
+fileDescriptor_t* fdt = NULL;
+int fdtSize = 0;
+// open descriptors : a stack of free descriptors, and the chains of open descriptors of the i-nodes
+// hashed to each of maxOpenFiles buckets
+int* freeDescriptors = NULL;
+int freeDescriptorCount;
+int* openDescriptors = NULL;
+int* nextDescriptor = NULL;
+// i-node cache : blocks of the i-node file found through a hash of their number. A miss takes
+// an empty slot or the least recently used clean one, dirty blocks stay until the next commit
+unsigned char* inodeCacheData = NULL;
+int* inodeSlotBlock = NULL;
+int* inodeSlotNext = NULL;
+long long* inodeSlotUsed = NULL;
+int* inodeBuckets = NULL;
+int inodeSlots;
+int numberOfInodeBuckets;
+long long inodeClock = 0;
+// root directory blocks in use, the size of the root i-node counts them. They are read when a path
+// is first looked up, and the next block of the region is added when every slot is taken
+directoryEntry_t** rootDirectory = NULL;
+int rootBlocksLoaded = 0;
+int inodesPerBlock;
+int entriesPerBlock;
+// hash index over the loaded root directory : bucket heads and chains of entry slots, and a stack of free slots
+int* nameBuckets = NULL;
+int* nameNext = NULL;
+int* freeEntries = NULL;
+int numberOfBuckets;
+int freeEntryCount;
+int entryCapacity = 0;
+// recent path component lookups in every directory
+dentry_t dentryCache[dentryCacheSize];
+// metadata blocks changed since the last flushMetadata, dirtyMetadata is indexed by block number
+unsigned char* dirtyMetadata = NULL;
+int* dirtyMetadataList = NULL;
+int dirtyMetadataCount = 0;
+// journal : next free journal block, sequence of the next transaction, operations since the last commit
+int journalHead = 1;
+int journalSequence = 1;
+int journalOps = 0;
+// set when a checkpoint failed once its flush was done, the journal super block may hold either
+// sequence so nothing is appended to the journal before a checkpoint goes through
+int checkpointPending = 0;
+// set while ssfs_batch runs, its operations share one commit as long as the journal holds them
+int inBatch = 0;
+// process that mounted the disk, a forked child never commits its copy of the metadata
+pid_t journalOwner = 0;
+int journalExitRegistered = 0;
+// backend the next mkssfs opens the disk with
+int diskBackend = defaultDiskBackend;
+// images of data region blocks changed since the last commit : pointer blocks and sub directory blocks
+int journaledBlockList[maxJournaledBlocks];
+unsigned char* journaledBlockData = NULL;
+int journaledBlockCount = 0;
+// every free bit map word before this one is full, allocations start scanning here
+int fbmHint = 0;
+// same for the i-node bit map
+int ibmHint = 0;
+// blocks held by each snapshot and their union, a block in the union is never changed in place
+// nor allocated again while a snapshot holds it
+unsigned char* snapshotBlocks[numberOfShadows];
+unsigned char* sharedBlocks = NULL;
+// i-node file and root directory blocks copied to the image of each snapshot, the others are still
+// shared with the live file system
+unsigned char* snapshotCopies[numberOfShadows];
+// blocks freed since the last checkpoint, a committed transaction replayed after a crash may still
+// write an old pointer or directory block over them so they are not allocated before the checkpoint
+unsigned char* releasedBlocks = NULL;
+int releasedBlockCount = 0;
+// super block as it is written to block 0
+unsigned char* superBlockImage = NULL;
+// locks, always taken in this order : fileSystemLock shared by every call and held alone by the snapshot calls,
+// directoryLock over the directories and the descriptor table, the lock of a descriptor over its pointers
+// and block map, the reader/writer lock of the stripe of a file's i-node over its data and size, then
+// allocatorLock over the free bit map, the i-node file, the journal and the snapshots
+pthread_rwlock_t fileSystemLock = PTHREAD_RWLOCK_INITIALIZER;
+pthread_mutex_t directoryLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t* descriptorLocks = NULL;
+pthread_rwlock_t* inodeLocks = NULL;
+int numberOfLocks = 0;
+pthread_mutex_t allocatorLock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
-initialize the inode file to have all free inode size set to -1 and direct and indirect to -1
-Set first inode to be the root Directory with data block 2,3,4,5.
+initialize the inode file to have all free inode size set to -1 and direct and indirect pointers to -1
+Set first inode to be the root Directory with the root directory data blocks.
+The blocks go straight to the new disk, the i-node cache starts empty.
 */
 void initializeInodeFiles(){
-	int i,k;
+	int i;
+	unsigned char block[sb.block_size];
+	inode_t* inodes = (inode_t*)block;
 	
 	inode_t tempInode;
 	tempInode.size = -1;
-	for (i =0 ; i < 14 ; i++){
+	for (i =0 ; i < numberOfDirect ; i++){
 		tempInode.direct[i] = -1;
 	}
 	tempInode.indirect = -1;
+	tempInode.doubleIndirect = -1;
+	tempInode.tripleIndirect = -1;
 	
 	// initialize all inode to be unused 
-	for (i = 0; i < 13 ; i++){
-	for (k = 0 ; k < 16; k++){
-		inodeBlocks[i].inodeSlot[k]=tempInode;
-		}
+	memset(block, 0, sb.block_size);
+	for (i = 0; i < inodesPerBlock ; i++){
+		inodes[i] = tempInode;
+	}
+	for (i = 1; i < sb.inodeTableBlocks; i++){
+		write_blocks(sb.inodeTableStart + i, 1, block);
 	}
 	
-	// first inode contains all 4 root directory block number 
+	// first inode contains the root directory block numbers 
 	tempInode.size = 0;
-	tempInode.direct[0] = sb.rootDirectoryBlockNumber[0];
-	tempInode.direct[1] = sb.rootDirectoryBlockNumber[1];
-	tempInode.direct[2] = sb.rootDirectoryBlockNumber[2];
-	tempInode.direct[3] = sb.rootDirectoryBlockNumber[3];
-	inodeBlocks[0].inodeSlot[0] = tempInode;
+	for (i = 0; i < numberOfDirect && i < sb.rootDirectoryBlocks; i++){
+		tempInode.direct[i] = sb.rootDirectoryStart + i;
+	}
+	inodes[0] = tempInode;
+	write_blocks(sb.inodeTableStart, 1, block);
 	
 }
 
 /*
-Initialize all 4 data blocks in root directory by creating an empty entry and setting each slot
+Initialize a block of the root directory by creating an empty entry and setting each slot
 with this entry. 
 */
 
-void initializeRootDirectory(){
-	int i,k;	
+void initializeRootBlock(directoryEntry_t* block){
+	int i;	
 	
 	directoryEntry_t entry;
+	memset(&entry, 0, sizeof(entry));
 	entry.inodeIndex = -1;
+	entry.type = entryFile;
 	strcpy(entry.name,"root/");
 
-	// initialize all entries of root directories with the empty entry
-	for (k = 0 ; k < 4 ; k++){
-		for (i = 0 ; i < numberOfEntries ; i++){
-			rootDirectory[k].entries[i] = entry;
-		}
+	// initialize all entries of the block with the empty entry
+	for (i = 0 ; i < entriesPerBlock ; i++){
+		block[i] = entry;
 	}
 }
 
 /*
-Initialize all superblock members 
+Lay a disk out from its geometry:
+super block, free bit map, i-node bit map, root directory, i-node file, journal then data blocks.
+layout : super block to fill
+blockSize : bytes per block, a power of 2 between 512 and 65536
+numberOfBlocks : blocks on the disk
+numberOfInodes : i-nodes in the i-node file, also the number of root directory entries
+return : 0 or -1 if the geometry can't hold a file system
 */
-void initializeSuperBlock(){
+int layoutSuperBlock(superblock_t* layout, int blockSize, int numberOfBlocks, int numberOfInodes){
 	
 	int i;
 	inode_t root;
-	root.size = 13312;
 	
-	// setting the block numbers to check for the root inode 
-	for( i = 0 ; i < 13 ; i++){
-		root.direct[i] = 6 + i;
+	if (blockSize < minBlockSize || blockSize > maxBlockSize || (blockSize & (blockSize - 1)) != 0){
+		return -1;
+	}
+	if (numberOfInodes < 2 || numberOfBlocks < 1){
+		return -1;
+	}
+	
+	memset(layout, 0, sizeof(superblock_t));
+	layout->magic[0] = 0xAC;
+	layout->magic[1] = 0xBD;
+	layout->magic[2] = 0x00;
+	layout->magic[3] = diskFormatVersion;
+	layout->block_size = blockSize;
+	layout->fs_size = numberOfBlocks; 
+	layout->Inodes = numberOfInodes;
+	
+	// one bit per block and per i-node, one slot per i-node 
+	layout->fbmStart = 1;
+	layout->fbmBlocks = (int)(((long)numberOfBlocks + 8L * blockSize - 1) / (8L * blockSize));
+	layout->ibmStart = layout->fbmStart + layout->fbmBlocks;
+	layout->ibmBlocks = (int)(((long)numberOfInodes + 8L * blockSize - 1) / (8L * blockSize));
+	layout->rootDirectoryStart = layout->ibmStart + layout->ibmBlocks;
+	layout->rootDirectoryBlocks = (int)(((long)numberOfInodes * sizeof(directoryEntry_t) + blockSize - 1) / blockSize);
+	layout->inodeTableStart = layout->rootDirectoryStart + layout->rootDirectoryBlocks;
+	layout->inodeTableBlocks = (int)(((long)numberOfInodes * sizeof(inode_t) + blockSize - 1) / blockSize);
+	layout->journalStart = layout->inodeTableStart + layout->inodeTableBlocks;
+	layout->journalBlocks = defaultJournalBlocks;
+	layout->dataStart = layout->journalStart + layout->journalBlocks;
+	
+	// need room for at least one data block 
+	if (layout->dataStart >= numberOfBlocks){
+		return -1;
 	}
 	
-	sb.magic[0] = 0xAC;
-	sb.magic[1] = 0xBD;
-	sb.magic[2] = 0x00;
-	sb.magic[3] = 0x05;
-	sb.block_size = blockSize;
-	sb.fs_size = blockSize * numberOfBlocks; 
-	sb.Inodes = numberOfInodes;
-	sb.root = root;
-	sb.rootDirectoryBlockNumber[0] = 2;
-	sb.rootDirectoryBlockNumber[1] = 3;
-	sb.rootDirectoryBlockNumber[2] = 4;
-	sb.rootDirectoryBlockNumber[3] = 5;
+	// j-node of the i-node file 
+	root.size = (long long)layout->inodeTableBlocks * blockSize;
+	for( i = 0 ; i < numberOfDirect ; i++){
+		root.direct[i] = i < layout->inodeTableBlocks ? layout->inodeTableStart + i : -1;
+	}
+	root.indirect = -1;
+	root.doubleIndirect = -1;
+	root.tripleIndirect = -1;
+	layout->root = root;
+	
+	// no snapshot yet 
+	root.size = -1;
+	for (i = 0; i < numberOfDirect; i++){
+		root.direct[i] = -1;
+	}
+	for (i = 0; i < numberOfShadows; i++){
+		layout->shadow[i] = root;
+	}
+	layout->lastShadow = -1;
+	layout->rollbackShadow = -1;
+	return 0;
 }
 
-
-/* 
-initialize file directory and set all values to free, rwptr to 0 and  no inode values. 
+/*
+Initialize all superblock members for a new disk. The mounted disk keeps its super block
+unless the new layout fits.
+return : 0 or -1 if the geometry can't hold a file system
 */
-void initializeFileDescriptorTable() {
-	int i;
-	fileDescriptor_t fd;
-	fd.free = -1;
-	fd.rwptr = 0;
-	fd.inode = -1;
-	fd.readptr = 0;
-	for (i = 0; i < numberOfInodes; i++){
-		fdt[i] = fd; 
+int initializeSuperBlock(int blockSize, int numberOfBlocks, int numberOfInodes){
+	superblock_t layout;
+	
+	if (layoutSuperBlock(&layout, blockSize, numberOfBlocks, numberOfInodes) < 0){
+		return -1;
 	}
+	sb = layout;
+	return 0;
+}
 
+/*
+Blocks of a snapshot image : the i-node file, the root directory, the bit map of the blocks the snapshot
+holds then the bit map of the i-node file and root directory blocks copied to the image
+*/
+int snapshotImageBlocks(superblock_t* layout){
+	int copies = layout->inodeTableBlocks + layout->rootDirectoryBlocks;
+	
+	return copies + layout->fbmBlocks + (int)(((long)copies + 8L * layout->block_size - 1) / (8L * layout->block_size));
 }
 
 /*
-Find a data block that is free using the FBM 
+Check a super block read from a disk before any of its sizes is used : the format version,
+the geometry, the regions that follow from it and the snapshot images.
+disk : super block as read from block 0
+return : 0 or -1 if the disk doesn't hold a file system of this format
 */
-int FBMGetFreeBit(){
-	int i,k;
+int checkSuperBlock(superblock_t* disk){
+	superblock_t layout;
+	int i;
+	long imageBlocks;
 	
-	for (i = 0; i < blockSize; i++){
-		for (k = 0; k < 8 ; k++){
-			if ((fbm.bytes[i] & (1 << k)) == (1 << k)){			
-				// set the bit to 0 
-				fbm.bytes[i] = fbm.bytes[i] ^ (1 << k);
-				return (i * 8 + k); 
-			}
-				
+	if (disk->magic[0] != 0xAC || disk->magic[1] != 0xBD || disk->magic[2] != 0x00 || disk->magic[3] != diskFormatVersion){
+		return -1;
+	}
+	if (layoutSuperBlock(&layout, disk->block_size, disk->fs_size, disk->Inodes) < 0){
+		return -1;
+	}
+	// every region from the free bit map to the data blocks 
+	if (memcmp(&disk->fbmStart, &layout.fbmStart, offsetof(superblock_t, dataStart) + sizeof(int) - offsetof(superblock_t, fbmStart)) != 0){
+		return -1;
+	}
+	if (disk->lastShadow < -1 || disk->lastShadow >= numberOfShadows){
+		return -1;
+	}
+	if (disk->rollbackShadow < -1 || disk->rollbackShadow >= numberOfShadows
+		|| (disk->rollbackShadow != -1 && disk->shadow[disk->rollbackShadow].size == -1)){
+		return -1;
+	}
+	imageBlocks = snapshotImageBlocks(&layout);
+	for (i = 0; i < numberOfShadows; i++){
+		if (disk->shadow[i].size == -1){
+			continue;
+		}
+		if (disk->shadow[i].size != imageBlocks * layout.block_size || disk->shadow[i].direct[0] < layout.dataStart
+			|| disk->shadow[i].direct[0] > layout.fs_size - imageBlocks){
+			return -1;
 		}
 	}
-	
-	return -1; 
+	return 0;
 }
 
 /*
-Initialize Free bit map by putting all data blocks to 1.
-Set the first 18 bits to be used for the super block,root directory, inode files and FBM
+Free the tables of the mounted disk, nothing is mounted afterwards
 */
-void initializeFBM(){
+void releaseTables(){
 	int i;
-	for (i = 0 ; i < blockSize; i++){
-		fbm.bytes[i] = 0xFF;
-	}
 	
-	// first 18 blocks are used when initializing 
-	for( i = 0 ; i < 18; i++){
-	FBMGetFreeBit();
+	free(fbm);
+	free(ibm);
+	free(inodeCacheData);
+	free(inodeSlotBlock);
+	free(inodeSlotNext);
+	free(inodeSlotUsed);
+	free(inodeBuckets);
+	for (i = 0; i < rootBlocksLoaded; i++){
+		free(rootDirectory[i]);
+	}
+	free(rootDirectory);
+	for (i = 0; i < fdtSize; i++){
+		free(fdt[i].blockMap);
+	}
+	free(fdt);
+	free(freeDescriptors);
+	free(openDescriptors);
+	free(nextDescriptor);
+	free(nameBuckets);
+	free(nameNext);
+	free(freeEntries);
+	free(dirtyMetadata);
+	free(dirtyMetadataList);
+	free(journaledBlockData);
+	free(superBlockImage);
+	free(sharedBlocks);
+	free(releasedBlocks);
+	for (i = 0; i < numberOfLocks; i++){
+		pthread_mutex_destroy(&descriptorLocks[i]);
+	}
+	for (i = 0; inodeLocks != NULL && i < inodeLockStripes; i++){
+		pthread_rwlock_destroy(&inodeLocks[i]);
+	}
+	free(descriptorLocks);
+	free(inodeLocks);
+	numberOfLocks = 0;
+	for (i = 0; i < numberOfShadows; i++){
+		free(snapshotBlocks[i]);
+		free(snapshotCopies[i]);
+		snapshotBlocks[i] = NULL;
+		snapshotCopies[i] = NULL;
 	}
 	
+	fbm = ibm = inodeCacheData = NULL;
+	inodeSlotBlock = inodeSlotNext = inodeBuckets = NULL;
+	inodeSlotUsed = NULL;
+	rootDirectory = NULL;
+	rootBlocksLoaded = 0;
+	entryCapacity = 0;
+	fdt = NULL;
+	fdtSize = 0;
+	freeDescriptors = openDescriptors = nextDescriptor = NULL;
+	nameBuckets = nameNext = freeEntries = NULL;
+	dirtyMetadata = superBlockImage = sharedBlocks = releasedBlocks = NULL;
+	releasedBlockCount = 0;
+	dirtyMetadataList = NULL;
+	dirtyMetadataCount = 0;
+	journaledBlockData = NULL;
+	journaledBlockCount = 0;
+	descriptorLocks = NULL;
+	inodeLocks = NULL;
 }
 
-/* 
-set the FBM bit to be the opposite of the current bit for the specific block number to indicate if block number is free.
+/*
+Allocate the in memory free bit map, i-node bit map, i-node cache, root directory and file descriptor table
+for the geometry in the super block. The root directory, the descriptor table and the locks don't grow with
+the number of i-nodes, the root directory blocks are read or added as they are needed.
 */
-int setFBMbit(int blockNumber){
-	int byte = blockNumber / 8;
-	int bit = blockNumber % 8;
-	fbm.bytes[byte] = fbm.bytes[byte] ^ (1 << bit); 
+int allocateTables(){
+	int i;
+	inodesPerBlock = sb.block_size / sizeof(inode_t);
+	entriesPerBlock = sb.block_size / sizeof(directoryEntry_t);
+	
+	releaseTables();
+	
+	// the name index grows with the root directory blocks loaded
+	numberOfBuckets = 1;
+	nameBuckets = malloc(sizeof(int) * numberOfBuckets);
+	// every block before the data blocks is metadata 
+	dirtyMetadata = calloc(sb.dataStart, 1);
+	dirtyMetadataList = malloc(sizeof(int) * sb.dataStart);
+	dirtyMetadataCount = 0;
+	journaledBlockData = malloc((size_t)maxJournaledBlocks * sb.block_size);
+	journaledBlockCount = 0;
+	superBlockImage = calloc(sb.block_size, 1);
+	fbm = malloc((size_t)sb.fbmBlocks * sb.block_size);
+	ibm = malloc((size_t)sb.ibmBlocks * sb.block_size);
+	// read 64 bits at a time next to the free bit map 
+	sharedBlocks = calloc(sb.fbmBlocks, sb.block_size);
+	releasedBlocks = calloc(sb.fbmBlocks, sb.block_size);
+	// the i-node cache never holds more than the i-node file 
+	inodeSlots = sb.inodeTableBlocks < inodeCacheBlocks ? sb.inodeTableBlocks : inodeCacheBlocks;
+	numberOfInodeBuckets = 1;
+	while (numberOfInodeBuckets < 2 * inodeSlots){
+		numberOfInodeBuckets *= 2;
+	}
+	inodeCacheData = malloc((size_t)inodeSlots * sb.block_size);
+	inodeSlotBlock = malloc(sizeof(int) * inodeSlots);
+	inodeSlotNext = malloc(sizeof(int) * inodeSlots);
+	inodeSlotUsed = malloc(sizeof(long long) * inodeSlots);
+	inodeBuckets = malloc(sizeof(int) * numberOfInodeBuckets);
+	rootDirectory = calloc(sb.rootDirectoryBlocks, sizeof(directoryEntry_t*));
+	fdt = malloc(sizeof(fileDescriptor_t) * maxOpenFiles);
+	fdtSize = fdt == NULL ? 0 : maxOpenFiles;
+	freeDescriptors = malloc(sizeof(int) * maxOpenFiles);
+	openDescriptors = malloc(sizeof(int) * maxOpenFiles);
+	nextDescriptor = malloc(sizeof(int) * maxOpenFiles);
+	
+	if (fbm == NULL || ibm == NULL || rootDirectory == NULL || fdt == NULL){
+		return -1;
+	}
+	if (inodeCacheData == NULL || inodeSlotBlock == NULL || inodeSlotNext == NULL || inodeSlotUsed == NULL || inodeBuckets == NULL){
+		return -1;
+	}
+	for (i = 0; i < inodeSlots; i++){
+		inodeSlotBlock[i] = -1;
+	}
+	for (i = 0; i < numberOfInodeBuckets; i++){
+		inodeBuckets[i] = -1;
+	}
+	if (freeDescriptors == NULL || openDescriptors == NULL || nextDescriptor == NULL){
+		return -1;
+	}
+	if (nameBuckets == NULL){
+		return -1;
+	}
+	nameBuckets[0] = -1;
+	freeEntryCount = 0;
+	if (dirtyMetadata == NULL || dirtyMetadataList == NULL || journaledBlockData == NULL){
+		return -1;
+	}
+	if (superBlockImage == NULL || sharedBlocks == NULL || releasedBlocks == NULL){
+		return -1;
+	}
 	
+	// one lock per descriptor, the i-nodes share the stripes 
+	descriptorLocks = malloc(sizeof(pthread_mutex_t) * maxOpenFiles);
+	inodeLocks = malloc(sizeof(pthread_rwlock_t) * inodeLockStripes);
+	if (descriptorLocks == NULL || inodeLocks == NULL){
+		free(inodeLocks);
+		inodeLocks = NULL;
+		return -1;
+	}
+	for (i = 0; i < inodeLockStripes; i++){
+		pthread_rwlock_init(&inodeLocks[i], NULL);
+	}
+	for (numberOfLocks = 0; numberOfLocks < maxOpenFiles; numberOfLocks++){
+		pthread_mutex_init(&descriptorLocks[numberOfLocks], NULL);
+	}
 	return 0;
 }
 
 /*
-Goes through each direct value of j-node then check the Inode files to look for a free i-node by checking if i-node size is -1.
-return : the inode index between 0 - 199
+Reader/writer lock of the stripe an i-node belongs to
 */
-int findFreeInodeIndex(){
-	int i,k;
-	int blockNumber;
-	int inodeIndex = -5;
-	
-	//check for all the i-nodes files
-	for (i = 0; i < 13; i++){
-		blockNumber = sb.root.direct[i];
-			
-		for(k = 0; k < 16; k++){
-			if (inodeBlocks[i].inodeSlot[k].size == -1){
-				inodeIndex = i * 16 + k ;
-				return inodeIndex;
-			}	
-		}
+pthread_rwlock_t* inodeLock(int inodeIndex){
+	return &inodeLocks[inodeIndex & (inodeLockStripes - 1)];
+}
+
+/*
+Hash a file name, names are at most 10 characters and may fill the whole name field
+*/
+unsigned int hashName(char* name){
+	unsigned int hash = 5381;
+	int i;
+	for (i = 0; i < 10 && name[i] != '\0'; i++){
+		hash = hash * 33 + (unsigned char)name[i];
 	}
-		
-	return inodeIndex;
-	
+	return hash;
 }
 
 /*
-Add new inode into the free slot of the i-node File
-inodeIndex : inode index to place the new inode in the i-node File
+Entry of the root directory in a slot of a loaded block
 */
-int rootAddInode(int inodeIndex){
-	int i = inodeIndex / 13;
-	int k;
-	inode_t newInode;
+directoryEntry_t* rootEntry(int slot){
+	return &rootDirectory[slot / entriesPerBlock][slot % entriesPerBlock];
+}
+
+/*
+Rebuild the name index and the free slot stack from the loaded root directory blocks.
+Free slots are pushed from the end so the lowest slot is reused first.
+*/
+void buildDirectoryIndex(){
+	int i;
+	unsigned int hash;
 	
-	for (k = 0 ; k < 14; k++){
-		newInode.direct[k] = -1;
+	for (i = 0; i < numberOfBuckets; i++){
+		nameBuckets[i] = -1;
 	}
+	freeEntryCount = 0;
 	
-	newInode.size = 0;
-	
-	for(k = 0 ; i<16; k++){
-		if (inodeBlocks[i].inodeSlot[k].size == -1){
-			inodeBlocks[i].inodeSlot[k] = newInode;
-			write_blocks(sb.root.direct[i], 1, &inodeBlocks[i]);
-			return 1;
-		} 
+	for (i = rootBlocksLoaded * entriesPerBlock - 1; i >= 0; i--){
+		if (rootEntry(i)->inodeIndex == -1){
+			freeEntries[freeEntryCount++] = i;
+		}
+		else {
+			hash = hashName(rootEntry(i)->name) & (numberOfBuckets - 1);
+			nameNext[i] = nameBuckets[hash];
+			nameBuckets[hash] = i;
+		}
 	}
-return -1;	
 }
 
-/*create a new file by creating a new entry and adding new entry to an available location in the root directory 
-fname : name of the file to be created 
+/*
+Make room in the name index and the free slot stack for the entries of a number of root directory blocks.
+At least as many buckets as entries keeps the chains short, the index is rebuilt when they grow.
+blocks : root directory blocks to hold
+return : 1 if the index has to be rebuilt, 0 if not, -1 if memory runs out
 */
-int createFile(char* fname){
-	int i,k;
-	int freeIndex = findFreeInodeIndex();
-	
-	directoryEntry_t entry;
-	stpcpy(entry.name,fname);
-	entry.inodeIndex = freeIndex;
-	
-	// check if file exist in the root directories 
-	for (k = 0 ; k < 4; k++){
-		for(i = 0 ; i < numberOfEntries ; i++){
-			
-			if ( strcmp(rootDirectory[k].entries[i].name, fname) == 0){
-				return -1;
-			}
+int reserveDirectoryIndex(int blocks){
+	int entries = blocks * entriesPerBlock;
+	int buckets = numberOfBuckets;
+	int* grown;
+	
+	if (entries > entryCapacity){
+		grown = realloc(nameNext, sizeof(int) * entries);
+		if (grown == NULL){
+			return -1;
 		}
-	}
-	// if doesn't exist, set new entry with name and inode associated to the file
-	for (k = 0 ; k < 4 ; k++){
-		for (i = 0; i < numberOfEntries; i++){
-			if (rootDirectory[k].entries[i].inodeIndex == -1){
-				rootDirectory[k].entries[i] = entry;
-				write_blocks(sb.rootDirectoryBlockNumber[k],1, &rootDirectory[k]);
-				break;
-			}
+		nameNext = grown;
+		grown = realloc(freeEntries, sizeof(int) * entries);
+		if (grown == NULL){
+			return -1;
 		}
+		freeEntries = grown;
+		entryCapacity = entries;
 	}
 	
-	rootAddInode(freeIndex);
-	
-	return 0;
+	while (buckets < entries){
+		buckets *= 2;
+	}
+	if (buckets == numberOfBuckets){
+		return 0;
+	}
+	grown = realloc(nameBuckets, sizeof(int) * buckets);
+	if (grown == NULL){
+		return -1;
+	}
+	nameBuckets = grown;
+	numberOfBuckets = buckets;
+	return 1;
 }
+
 /*
-Allocate a new data block when writing in a file if not enough available bytes to write.
-inodeIndex : allocate new block to the specific i-node and set that block in the i-node direct
+find the slot of a file in the root directory
+name : file name
+return : entry slot or -1
 */
-int allocateDataBlock(int inodeIndex){
-	int i = inodeIndex / 13;
-	int slot = inodeIndex % 13;
-	int newBlockNumber = FBMGetFreeBit();
-	int k,m;
-	
-	for (k = 0; k < 14 ; k++){
-		if(inodeBlocks[i].inodeSlot[slot].direct[k] == -1){
-			inodeBlocks[i].inodeSlot[slot].direct[k] = newBlockNumber;
-			write_blocks(sb.root.direct[i],1, &inodeBlocks[i]);
-			return newBlockNumber;
-		}
-	}
+int findEntrySlot(char* name){
+	int i;
 	
-	// maximum of 74 extra inodes for a single file 
-	for (m = 0; m < 74; m++){
-		// if all the direct data blocks are already allocated then need to check the indirect blocks
-		if (inodeBlocks[i].inodeSlot[slot].indirect == -1){
-			// allocate new i-node index to the indirect
-			// get new free data block by checking the FBM 
-			inodeBlocks[i].inodeSlot[slot].indirect = FBMGetFreeBit();
-			// create new i-node for the file 
-			rootAddInode(inodeBlocks[i].inodeSlot[slot].indirect);
-			// need to create a new inode block that stores this data	
-		}
-		// goes to next indirect i-node 
-		else {
-			i = inodeBlocks[i].inodeSlot[slot].indirect / 13;
-			slot = inodeBlocks[i].inodeSlot[slot].indirect % 13;
+	for (i = nameBuckets[hashName(name) & (numberOfBuckets - 1)]; i != -1; i = nameNext[i]){
+		if (strncmp(rootEntry(i)->name, name, 10) == 0){
+			return i;
 		}
 	}
-	
 	return -1;
+}
+
+/*
+Link a used slot taken from the free slot stack into the name index
+*/
+void addEntrySlot(int entry){
+	unsigned int hash = hashName(rootEntry(entry)->name) & (numberOfBuckets - 1);
 	
+	nameNext[entry] = nameBuckets[hash];
+	nameBuckets[hash] = entry;
 }
+
 /*
-make a shadow file system
-fresh : if fresh > 0 then initialize the disk else recover persistance values in the disk 
+Unlink a used slot from the name index and give it back to the free slot stack
 */
-void mkssfs(int fresh){
+void removeEntrySlot(int entry){
+	int* link = &nameBuckets[hashName(rootEntry(entry)->name) & (numberOfBuckets - 1)];
+	
+	while (*link != entry){
+		link = &nameNext[*link];
+	}
+	*link = nameNext[entry];
+	freeEntries[freeEntryCount++] = entry;
+}
+
+
+/*
+Forget the access pattern seen through a file descriptor, the next access from offset 0 counts as sequential
+*/
+void resetAccessPattern(int fileID){
+	fdt[fileID].lastReadEnd = 0;
+	fdt[fileID].readAhead = 0;
+	fdt[fileID].readAheadEnd = 0;
+	fdt[fileID].lastWriteEnd = 0;
+	fdt[fileID].writeBehindStart = 0;
+}
+
+/*
+Bucket of the open descriptors of an i-node, the chain also holds those of other i-nodes
+*/
+int openBucket(int inodeIndex){
+	return inodeIndex & (maxOpenFiles - 1);
+}
+
+/*
+First open descriptor of an i-node
+return : descriptor or -1 if the file isn't open
+*/
+int openDescriptorOf(int inodeIndex){
 	int i;
-	initializeFileDescriptorTable();
-		
-	if (fresh){
 	
-		initializeFBM();
-		initializeSuperBlock();
-		initializeInodeFiles();
-		initializeRootDirectory();
+	for (i = openDescriptors[openBucket(inodeIndex)]; i != -1 && fdt[i].inode != inodeIndex; i = nextDescriptor[i]);
+	return i;
+}
 
-		//create a new file system
-		char* filename = "WDDNGUYEN";
-		
-		init_fresh_disk(filename, blockSize, numberOfBlocks);
-		
-		initializeFileDescriptorTable();
-		
-		write_blocks(0,1, &sb);
-		write_blocks(1,1, &fbm);		
-		write_blocks(sb.rootDirectoryBlockNumber[0],1, &rootDirectory[0]);
-		write_blocks(sb.rootDirectoryBlockNumber[1],1, &rootDirectory[1]);
-		write_blocks(sb.rootDirectoryBlockNumber[2],1, &rootDirectory[2]);
-		write_blocks(sb.rootDirectoryBlockNumber[3],1, &rootDirectory[3]);
-		for (i = 0; i < 13; i++){
-			write_blocks(6 + i, 1, &inodeBlocks[i]);
-		}
-		
+/* 
+initialize file directory and set all values to free, rwptr to 0 and  no inode values. 
+*/
+void initializeFileDescriptorTable() {
+	int i;
+	fileDescriptor_t fd;
+	fd.free = -1;
+	fd.rwptr = 0;
+	fd.inode = -1;
+	fd.readptr = 0;
+	fd.blockMap = NULL;
+	fd.mapLength = 0;
+	for (i = 0; i < fdtSize; i++){
+		fdt[i] = fd; 
+		resetAccessPattern(i);
+		openDescriptors[i] = -1;
 	}
-	// Shadow file system already exist 
-	else {
-	
-	char* filename = "WDDNGUYEN";
-	initializeFileDescriptorTable();
-	init_disk(filename, blockSize, numberOfBlocks);
 	
-	// open super block 
-	read_blocks(0,1,&sb);
-	// open FBM 
-	read_blocks(1,1,&fbm);
-	// open root directory
-	read_blocks(sb.rootDirectoryBlockNumber[0],1,&rootDirectory[0]);
-	read_blocks(sb.rootDirectoryBlockNumber[1],1,&rootDirectory[1]);
-	read_blocks(sb.rootDirectoryBlockNumber[2],1,&rootDirectory[2]);
-	read_blocks(sb.rootDirectoryBlockNumber[3],1,&rootDirectory[3]);
-	//open all inode file to cache 
-	for(i = 0; i < 13; i++){
-		read_blocks(sb.root.direct[i], 1 , &inodeBlocks[i]);
+	// lowest descriptors on top of the free stack 
+	freeDescriptorCount = 0;
+	for (i = fdtSize - 1; i >= 0; i--){
+		freeDescriptors[freeDescriptorCount++] = i;
 	}
+
+}
+
+/*
+Forget a dirty metadata block that was written to its place without the journal
+*/
+void forgetMetadataDirty(int blockNumber){
+	int i;
+	
+	if (!dirtyMetadata[blockNumber]){
+		return;
 	}
- 
+	dirtyMetadata[blockNumber] = 0;
+	for (i = 0; dirtyMetadataList[i] != blockNumber; i++);
+	dirtyMetadataList[i] = dirtyMetadataList[--dirtyMetadataCount];
 }
 
 /*
-find the entry in the root directory
-name : search for the entry with the file name 
-return : the inode index of the entry 
+Slot of a block of the i-node file in the i-node cache, or -1
 */
-int findEntry(char *name){
-	int i,k;
+int findInodeSlot(int block){
+	int slot;
 	
-	// check if file is already in root directory then add to open file descriptor
-	for (k = 0 ; k < 4; k ++){
-		for (i = 0; i < numberOfEntries ; i++){
-			if (strcmp(rootDirectory[k].entries[i].name, name) == 0){
-				return rootDirectory[k].entries[i].inodeIndex;
-			}		
+	for (slot = inodeBuckets[block & (numberOfInodeBuckets - 1)]; slot != -1; slot = inodeSlotNext[slot]){
+		if (inodeSlotBlock[slot] == block){
+			return slot;
 		}
 	}
 	return -1;
 }
+
 /*
-Open a file by checking if file exist in the root directory and place the file in a file descriptor table when writing/reading
-if file doesn't exist, create a new file, add into the root directory then place the file in the file descriptor table. 
-name : name of the file to open .
-return : file descriptor index
+In memory copy of a metadata block : super block, free bit map, i-node bit map, root directory or i-node file block
 */
-int ssfs_fopen(char *name){
-	int i;
-	int inodeIndex = -1;
-	
-	//file name too big 
-	if (strlen(name) > 10){
-		return -1;
+void* metadataBuffer(int blockNumber){
+	if (blockNumber == 0){
+		memcpy(superBlockImage, &sb, sizeof(sb));
+		return superBlockImage;
 	}
-	
-	// search root directory for file name
-	inodeIndex = findEntry(name);
-	// if doesnt exist then create a new file 
-	if(inodeIndex == -1){
-		createFile(name);
-		inodeIndex = findEntry(name);
-		if (inodeIndex == -1){
-			printf("too many files in root directory");
-			return -1;
-		}
+	if (blockNumber < sb.ibmStart){
+		return fbm + (size_t)(blockNumber - sb.fbmStart) * sb.block_size;
 	}
-	
-	//check if fdt already has a file open
-	for(i = 0; i < numberOfInodes;i++){
-		if(fdt[i].inode == inodeIndex){
-			// need to adjust write pointer to last written file  when open    
-			
-			// get size of inode 
-			int block = fdt[i].inode/ 13; 
-			int slotIndex = fdt[i].inode % 13;
-			int size = inodeBlocks[block].inodeSlot[slotIndex].size;
-			
-			fdt[i].rwptr = size;
-			fdt[i].readptr = 0;
-			return i;
-		}
+	if (blockNumber < sb.rootDirectoryStart){
+		return ibm + (size_t)(blockNumber - sb.ibmStart) * sb.block_size;
 	}
-	
-	//check for free space in fdt and add inode index to the table
-	for(i = 0; i < numberOfInodes; i++){
-		if(fdt[i].free == -1){
-			fdt[i].inode = inodeIndex;
-			fdt[i].rwptr = 0;
-			fdt[i].free = 0;
-			fdt[i].readptr = 0;
+	// a dirty root directory block is loaded 
+	if (blockNumber < sb.inodeTableStart){
+		return rootDirectory[blockNumber - sb.rootDirectoryStart];
+	}
+	// a dirty i-node block stays cached until the commit 
+	return inodeCacheData + (size_t)findInodeSlot(blockNumber - sb.inodeTableStart) * sb.block_size;
+}
+
+int compareBlockNumbers(const void* a, const void* b){
+	return *(const int*)a - *(const int*)b;
+}
+
+/*
+Find the pending image of a journaled data region block
+return : index in the journaled block list or -1
+*/
+int findJournaledBlock(int blockNumber){
+	int i;
+	for (i = 0; i < journaledBlockCount; i++){
+		if (journaledBlockList[i] == blockNumber){
 			return i;
 		}
 	}
-	
 	return -1;
-	
 }
+
 /*
-Close the file descriptor table
-fileID : the index of the file descriptor table
+Read a pointer block or a sub directory block, the image waiting for the journal is the current one
 */
-
-int ssfs_fclose(int fileID){
-
-	//invalid fileID
-	if(fileID < 0 || fileID >= numberOfInodes){
-		//printf("invalid fileID\n");
-		return -1;
-	}
+void readJournaledBlock(int blockNumber, void* buffer){
+	int i = findJournaledBlock(blockNumber);
 	
-	//if file ID is not open 
-	if (fdt[fileID].free == -1){
-		//printf("fdt location is free\n");
-		return -1;
+	if (i == -1){
+		cache_read_blocks(blockNumber, 1, buffer);
+	}
+	else {
+		memcpy(buffer, journaledBlockData + (size_t)i * sb.block_size, sb.block_size);
 	}
-	// remove fdt open file
-	fdt[fileID].inode = -1;
-	fdt[fileID].rwptr = 0;
-	fdt[fileID].readptr = 0;
-	fdt[fileID].free = -1;
-	return 0;	
-	
 }
 
 /*
-seek the read pointer of the file descriptor table to the specific byte location
-fileID : file descriptor table index
-loc : byte location for read pointer to be placed.
+Forget the pending image of a block that was freed, it may come back as file data
 */
-int ssfs_frseek(int fileID, int loc){
-	// check if fileID is valid
-	
-	if (loc < 0){
-		return -1;
-	}
+void dropJournaledBlock(int blockNumber){
+	int i = findJournaledBlock(blockNumber);
 	
-	if(fileID < 0 || fileID >= numberOfInodes){
-		return -1;
+	if (i != -1){
+		journaledBlockCount--;
+		journaledBlockList[i] = journaledBlockList[journaledBlockCount];
+		memcpy(journaledBlockData + (size_t)i * sb.block_size, journaledBlockData + (size_t)journaledBlockCount * sb.block_size, sb.block_size);
+	}
+}
+
+/*
+Checksum of a journal transaction, FNV-1a over its header fields and block images
+*/
+unsigned int journalChecksum(journalHeader_t* header, void** images){
+	unsigned int hash = 2166136261u;
+	unsigned char* bytes = (unsigned char*)&header->sequence;
+	size_t i, length = offsetof(journalHeader_t, checksum) - offsetof(journalHeader_t, sequence);
+	int k;
+	
+	for (i = 0; i < length; i++){
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	bytes = (unsigned char*)header->blocks;
+	for (i = 0; i < sizeof(int) * header->count; i++){
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	for (k = 0; k < header->count; k++){
+		bytes = images[k];
+		for (i = 0; i < (size_t)sb.block_size; i++){
+			hash = (hash ^ bytes[i]) * 16777619u;
+		}
+	}
+	return hash;
+}
+
+/*
+Largest transaction the journal holds : one header block listing the blocks, then their images
+*/
+int journalCapacity(){
+	int listed = (sb.block_size - (int)sizeof(journalHeader_t)) / (int)sizeof(int);
+	return listed < sb.journalBlocks - 2 ? listed : sb.journalBlocks - 2;
+}
+
+/*
+Write the journal super block : replay starts after it with the transaction numbered sequence
+return : 0 or -1
+*/
+int writeJournalSuper(int sequence){
+	unsigned char block[sb.block_size];
+	journalSuper_t* super = (journalSuper_t*)block;
+	
+	memset(block, 0, sb.block_size);
+	super->magic = journalSuperMagic;
+	super->sequence = sequence;
+	return write_blocks(sb.journalStart, 1, block);
+}
+
+/*
+Checkpoint : once the cache is flushed and the disk synced every committed transaction is home.
+The journal super block then moves the replay past them, the journal starts over and the blocks
+freed until now can be allocated again.
+return : 0 or -1
+*/
+int checkpointJournal(){
+	// a transaction whose blocks are not home stays in the journal for the next try or the replay 
+	if (flush_cache() < 0 || sync_disk() < 0){
+		return -1;
+	}
+	// the old transactions are only forgotten once the super block saying so is durable 
+	if (writeJournalSuper(journalSequence) < 0 || sync_disk() < 0){
+		checkpointPending = 1;
+		return -1;
+	}
+	checkpointPending = 0;
+	journalHead = 1;
+	memset(releasedBlocks, 0, (size_t)sb.fbmBlocks * sb.block_size);
+	releasedBlockCount = 0;
+	fbmHint = 0;
+	return 0;
+}
+
+/*
+Group commit : every metadata block changed since the last commit is written to the journal
+as one transaction, after the file data it points to, and a single sync makes it durable.
+The blocks then go to their place through the cache. When the journal is full the transactions
+in it are already home once the cache is flushed, a checkpoint lets it start over.
+return : 0 or -1
+*/
+int commitJournal(){
+	int i;
+	int ret = 0;
+	int committed = 0;
+	int count = dirtyMetadataCount + journaledBlockCount;
+	int* blocks;
+	int* positions;
+	void** buffers;
+	
+	if (count == 0 || journalOwner != getpid()){
+		return 0;
+	}
+	
+	blocks = malloc(sizeof(int) * count);
+	positions = malloc(sizeof(int) * count);
+	buffers = malloc(sizeof(void*) * count);
+	qsort(dirtyMetadataList, dirtyMetadataCount, sizeof(int), compareBlockNumbers);
+	for (i = 0; i < dirtyMetadataCount; i++){
+		blocks[i] = dirtyMetadataList[i];
+		buffers[i] = metadataBuffer(dirtyMetadataList[i]);
+	}
+	for (i = 0; i < journaledBlockCount; i++){
+		blocks[dirtyMetadataCount + i] = journaledBlockList[i];
+		buffers[dirtyMetadataCount + i] = journaledBlockData + (size_t)i * sb.block_size;
+	}
+	
+	// ordered mode : the file data reaches the disk before the metadata pointing to it 
+	if (flush_cache() < 0){
+		ret = -1;
+	}
+	else if (count <= journalCapacity()){
+		unsigned char block[sb.block_size];
+		journalHeader_t* header = (journalHeader_t*)block;
+		
+		memset(block, 0, sb.block_size);
+		header->magic = journalMagic;
+		header->sequence = journalSequence;
+		header->count = count;
+		memcpy(header->blocks, blocks, sizeof(int) * count);
+		header->checksum = journalChecksum(header, buffers);
+		
+		// the journal bypasses the cache, the sync is the commit point 
+		if ((checkpointPending || journalHead + 1 + count > sb.journalBlocks) && checkpointJournal() < 0){
+			ret = -1;
+		}
+		else {
+			for (i = 0; i < count; i++){
+				positions[i] = sb.journalStart + journalHead + 1 + i;
+			}
+			if (write_blocks(sb.journalStart + journalHead, 1, block) < 0 || write_block_list(count, positions, buffers) < 0
+				|| sync_disk() < 0){
+				ret = -1;
+			}
+			else {
+				committed = 1;
+				journalHead += 1 + count;
+				journalSequence++;
+				// a block that doesn't reach home now is replayed at mount 
+				if (cache_write_block_list(count, blocks, buffers) < 0){
+					ret = -1;
+				}
+			}
+		}
+	}
+	// too big for the journal, written in place without atomicity. Replaying an older transaction
+	// would undo part of it, the checkpoint drops them 
+	else if (cache_write_block_list(count, blocks, buffers) < 0 || checkpointJournal() < 0){
+		ret = -1;
+	}
+	else {
+		committed = 1;
+	}
+	
+	// a commit that failed leaves every block dirty, the next one tries them again 
+	if (committed){
+		for (i = 0; i < dirtyMetadataCount; i++){
+			dirtyMetadata[dirtyMetadataList[i]] = 0;
+		}
+		dirtyMetadataCount = 0;
+		journaledBlockCount = 0;
+		journalOps = 0;
+	}
+	free(blocks);
+	free(positions);
+	free(buffers);
+	return ret;
+}
+
+/*
+Change a pointer block or a sub directory block. Like the metadata regions it only reaches
+its place on the disk after the journal commit holding it.
+*/
+void writeJournaledBlock(int blockNumber, void* buffer){
+	int i = findJournaledBlock(blockNumber);
+	
+	if (i == -1){
+		// no room left, commit what the operation changed so far. If the device fails the commit
+		// the block goes to its place without the journal rather than be lost
+		if (journaledBlockCount == maxJournaledBlocks && commitJournal() < 0){
+			cache_write_blocks(blockNumber, 1, buffer);
+			return;
+		}
+		i = journaledBlockCount++;
+		journaledBlockList[i] = blockNumber;
+	}
+	memcpy(journaledBlockData + (size_t)i * sb.block_size, buffer, sb.block_size);
+}
+
+/*
+Place of an i-node file or root directory block in a snapshot image, also its bit in the bit map of the copies
+return : offset in the image or -1 for the other blocks
+*/
+int imageOffset(int blockNumber){
+	if (blockNumber >= sb.inodeTableStart && blockNumber < sb.inodeTableStart + sb.inodeTableBlocks){
+		return blockNumber - sb.inodeTableStart;
+	}
+	if (blockNumber >= sb.rootDirectoryStart && blockNumber < sb.inodeTableStart){
+		return sb.inodeTableBlocks + blockNumber - sb.rootDirectoryStart;
+	}
+	return -1;
+}
+
+/*
+Check if a snapshot image holds its own copy of a block or still shares it with the live file system
+*/
+int isCopiedToImage(int id, int offset){
+	return (snapshotCopies[id][offset / 8] >> (offset % 8)) & 1;
+}
+
+/*
+Copy an i-node file or root directory block to the image of every snapshot still sharing it, before its first
+change reaches the disk. The copy goes through the cache, which the commit flushes before the journal holding
+both the change and the bit that records the copy.
+*/
+void copyToSnapshots(int blockNumber){
+	int offset = imageOffset(blockNumber);
+	int k, mapBlock;
+	int loaded = 0;
+	int mapStart = sb.inodeTableBlocks + sb.rootDirectoryBlocks + sb.fbmBlocks;
+	unsigned char block[sb.block_size];
+	
+	if (offset == -1){
+		return;
+	}
+	mapBlock = offset / (8 * sb.block_size);
+	for (k = 0; k < numberOfShadows; k++){
+		if (snapshotCopies[k] == NULL || isCopiedToImage(k, offset)){
+			continue;
+		}
+		// the change is only in memory, the block's place still holds the last commit 
+		if (!loaded && cache_read_blocks(blockNumber, 1, block) < 0){
+			return;
+		}
+		loaded = 1;
+		cache_write_blocks(sb.shadow[k].direct[0] + offset, 1, block);
+		snapshotCopies[k][offset / 8] |= 1 << (offset % 8);
+		writeJournaledBlock(sb.shadow[k].direct[0] + mapStart + mapBlock, snapshotCopies[k] + (size_t)mapBlock * sb.block_size);
+	}
+}
+
+/*
+Remember that a metadata block changed, it is written once by the next flushMetadata
+however many times it changes until then. A snapshot sharing the block gets its copy first.
+*/
+void markMetadataDirty(int blockNumber){
+	if (!dirtyMetadata[blockNumber]){
+		copyToSnapshots(blockNumber);
+		dirtyMetadata[blockNumber] = 1;
+		dirtyMetadataList[dirtyMetadataCount++] = blockNumber;
+	}
+}
+
+/*
+End the transaction of an operation, its metadata changes wait in memory for a group commit.
+A commit happens every groupCommitOps operations, not during a batch, or once the changes fill half the journal.
+return : 0 or -1
+*/
+int endTransaction(){
+	journalOps++;
+	if ((!inBatch && journalOps >= groupCommitOps) || (dirtyMetadataCount + journaledBlockCount) * 2 >= journalCapacity()){
+		return commitJournal();
+	}
+	return 0;
+}
+
+/*
+Redo the transactions committed since the last checkpoint. They follow the journal super block
+with increasing sequence numbers from the one it records, the first torn or stale one ends the replay.
+Replaying a transaction that already reached home writes the same images again. The replayed
+transactions are checkpointed, the sequence carries on after them so no stale one can follow.
+*/
+void replayJournal(){
+	unsigned char block[sb.block_size];
+	journalHeader_t* header = (journalHeader_t*)block;
+	journalSuper_t* super = (journalSuper_t*)block;
+	unsigned char* images;
+	void** buffers;
+	int i;
+	int position = 1;
+	int expected;
+	int replayed = 0;
+	int capacity = journalCapacity();
+	
+	read_blocks(sb.journalStart, 1, block);
+	if (super->magic != journalSuperMagic || super->sequence < 1){
+		// nothing in a journal without its super block can be trusted, it starts over empty 
+		memset(block, 0, sb.block_size);
+		for (i = 1; i < sb.journalBlocks; i++){
+			write_blocks(sb.journalStart + i, 1, block);
+		}
+		journalSequence = 1;
+		journalHead = 1;
+		checkpointPending = writeJournalSuper(journalSequence) < 0 || sync_disk() < 0;
+		return;
+	}
+	expected = super->sequence;
+	
+	images = malloc((size_t)capacity * sb.block_size);
+	buffers = malloc(sizeof(void*) * capacity);
+	
+	while (position + 1 < sb.journalBlocks){
+		read_blocks(sb.journalStart + position, 1, block);
+		if (header->magic != journalMagic || header->count < 1 || header->count > capacity){
+			break;
+		}
+		if (position + 1 + header->count > sb.journalBlocks || header->sequence != expected){
+			break;
+		}
+		read_blocks(sb.journalStart + position + 1, header->count, images);
+		for (i = 0; i < header->count; i++){
+			buffers[i] = images + (size_t)i * sb.block_size;
+		}
+		if (journalChecksum(header, buffers) != header->checksum){
+			break;
+		}
+		
+		write_block_list(header->count, header->blocks, buffers);
+		expected = header->sequence + 1;
+		position += 1 + header->count;
+		replayed = 1;
+	}
+	
+	// the images are home before the journal is written over 
+	journalSequence = expected;
+	journalHead = 1;
+	checkpointPending = 0;
+	if (replayed && (sync_disk() < 0 || writeJournalSuper(journalSequence) < 0 || sync_disk() < 0)){
+		checkpointPending = 1;
+	}
+	free(images);
+	free(buffers);
+}
+
+/*
+Commit what is left when the process exits, before the cache writes its dirty blocks back
+*/
+void commitAtExit(){
+	pthread_mutex_lock(&allocatorLock);
+	commitJournal();
+	pthread_mutex_unlock(&allocatorLock);
+}
+
+/*
+atexit handlers run last registered first, registering after the cache commits before it flushes
+*/
+void registerJournalExit(){
+	if (!journalExitRegistered){
+		atexit(commitAtExit);
+		journalExitRegistered = 1;
+	}
+}
+
+/*
+Mark the free bit map block holding the bit of blockNumber to be written back
+*/
+void writeFBMBlock(int blockNumber){
+	markMetadataDirty(sb.fbmStart + blockNumber / (8 * sb.block_size));
+}
+
+/*
+Make the blocks freed since the last checkpoint available again when an allocation runs short :
+the operation so far is committed, then the journal is checkpointed
+return : 1 if blocks came back, 0 if there were none
+*/
+int reclaimReleasedBlocks(){
+	if (releasedBlockCount == 0 || journalOwner != getpid()){
+		return 0;
+	}
+	if (commitJournal() < 0 || checkpointJournal() < 0){
+		return 0;
+	}
+	return 1;
+}
+
+/*
+Find a data block that is free using the FBM.
+The map is scanned 64 blocks at a time from the first word that may have a free bit,
+the bit order of a word matches the byte order of the map on little endian hosts.
+*/
+int FBMGetFreeBit(){
+	uint64_t* words = (uint64_t*)fbm;
+	uint64_t* shared = (uint64_t*)sharedBlocks;
+	uint64_t* released = (uint64_t*)releasedBlocks;
+	int numberOfWords = (sb.fs_size + 63) / 64;
+	int i, blockNumber;
+	uint64_t w;
+	
+	// bits past fs_size are never set so a set bit is always a block on the disk,
+	// a block a snapshot holds stays out of reach after the live file system freed it,
+	// so does a block freed since the last checkpoint
+	for (i = fbmHint; i < numberOfWords; i++){
+		w = words[i] & ~shared[i] & ~released[i];
+		if (w != 0){
+			blockNumber = i * 64 + __builtin_ctzll(w);
+			// set the bit to 0 
+			words[i] &= ~(1ULL << (blockNumber % 64));
+			fbmHint = i;
+			writeFBMBlock(blockNumber);
+			return blockNumber;
+		}
+	}
+	
+	fbmHint = numberOfWords;
+	if (reclaimReleasedBlocks()){
+		return FBMGetFreeBit();
+	}
+	return -1; 
+}
+
+/*
+Extent allocator : find a run of free data blocks and mark it used.
+The first run of at least want blocks is taken, if there is none the largest run is taken.
+want : number of contiguous blocks wanted
+length : set to the number of blocks in the run, at most want
+return : first block of the run or -1 if the disk is full
+*/
+int FBMGetFreeRun(int want, int* length){
+	uint64_t* words = (uint64_t*)fbm;
+	uint64_t* shared = (uint64_t*)sharedBlocks;
+	uint64_t* released = (uint64_t*)releasedBlocks;
+	uint64_t w;
+	int i = fbmHint * 64;
+	int start, runLength;
+	int best = -1;
+	int bestLength = 0;
+	
+	while (i < sb.fs_size && bestLength < want){
+		// skip to the next free block 
+		w = (words[i / 64] & ~shared[i / 64] & ~released[i / 64]) >> (i % 64);
+		if (w == 0){
+			i = (i / 64 + 1) * 64;
+			continue;
+		}
+		i += __builtin_ctzll(w);
+		start = i;
+		
+		// extend the run up to the next used block 
+		while (i < sb.fs_size && i - start < want){
+			w = ~(words[i / 64] & ~shared[i / 64] & ~released[i / 64]) >> (i % 64);
+			if (w == 0){
+				i = (i / 64 + 1) * 64;
+			}
+			else {
+				i += __builtin_ctzll(w);
+				break;
+			}
+		}
+		
+		runLength = i - start < want ? i - start : want;
+		if (runLength > bestLength){
+			best = start;
+			bestLength = runLength;
+		}
+	}
+	
+	if (best == -1 && reclaimReleasedBlocks()){
+		return FBMGetFreeRun(want, length);
+	}
+	if (best == -1){
+		return -1;
+	}
+	
+	// set the bits to 0 and write every FBM block they live in 
+	for (i = best; i < best + bestLength; i++){
+		fbm[i / 8] &= ~(1 << (i % 8));
+	}
+	for (i = best / (8 * sb.block_size); i <= (best + bestLength - 1) / (8 * sb.block_size); i++){
+		writeFBMBlock(i * 8 * sb.block_size);
+	}
+	
+	*length = bestLength;
+	return best;
+}
+
+/*
+Initialize Free bit map by putting all data blocks to 1.
+The blocks before dataStart are used for the super block, the bit maps, root directory, inode files and journal
+*/
+void initializeFBM(){
+	int i;
+	memset(fbm, 0, (size_t)sb.fbmBlocks * sb.block_size);
+	
+	for (i = sb.dataStart ; i < sb.fs_size; i++){
+		fbm[i / 8] |= 1 << (i % 8);
+	}
+	fbmHint = 0;
+	
+}
+
+/* 
+set the FBM bit to be the opposite of the current bit for the specific block number to indicate if block number is free.
+*/
+int setFBMbit(int blockNumber){
+	int byte = blockNumber / 8;
+	int bit = blockNumber % 8;
+	fbm[byte] = fbm[byte] ^ (1 << bit); 
+	writeFBMBlock(blockNumber);
+	dropJournaledBlock(blockNumber);
+	
+	// a freed block waits for the next checkpoint 
+	if ((fbm[byte] >> bit) & 1 && !((releasedBlocks[byte] >> bit) & 1)){
+		releasedBlocks[byte] |= 1 << bit;
+		releasedBlockCount++;
+	}
+	
+	// a freed block may be before the first word with a free bit 
+	if (blockNumber / 64 < fbmHint){
+		fbmHint = blockNumber / 64;
+	}
+	return 0;
+}
+
+/*
+Rebuild the union of the blocks the snapshots hold after one is taken or dropped
+*/
+void buildSharedBlocks(){
+	size_t i;
+	size_t bytes = (size_t)sb.fbmBlocks * sb.block_size;
+	int k;
+	
+	memset(sharedBlocks, 0, bytes);
+	for (k = 0; k < numberOfShadows; k++){
+		if (snapshotBlocks[k] != NULL){
+			for (i = 0; i < bytes; i++){
+				sharedBlocks[i] |= snapshotBlocks[k][i];
+			}
+		}
+	}
+	// blocks of a dropped snapshot may be anywhere 
+	fbmHint = 0;
+}
+
+/*
+Read the bit map of blocks held by every snapshot on the disk and the bit map of the blocks copied to its image
+*/
+void loadSnapshots(){
+	int k;
+	int heldStart = sb.inodeTableBlocks + sb.rootDirectoryBlocks;
+	int mapBlocks = snapshotImageBlocks(&sb) - heldStart - sb.fbmBlocks;
+	
+	for (k = 0; k < numberOfShadows; k++){
+		if (sb.shadow[k].size == -1){
+			continue;
+		}
+		snapshotBlocks[k] = malloc((size_t)sb.fbmBlocks * sb.block_size);
+		snapshotCopies[k] = malloc((size_t)mapBlocks * sb.block_size);
+		if (snapshotBlocks[k] == NULL || snapshotCopies[k] == NULL){
+			free(snapshotBlocks[k]);
+			free(snapshotCopies[k]);
+			snapshotBlocks[k] = NULL;
+			snapshotCopies[k] = NULL;
+			continue;
+		}
+		read_blocks(sb.shadow[k].direct[0] + heldStart, sb.fbmBlocks, snapshotBlocks[k]);
+		read_blocks(sb.shadow[k].direct[0] + heldStart + sb.fbmBlocks, mapBlocks, snapshotCopies[k]);
+	}
+	buildSharedBlocks();
+}
+
+/*
+Check if a snapshot holds a block, the live file system has to copy it before changing it
+*/
+int isSharedBlock(int blockNumber){
+	return (sharedBlocks[blockNumber / 8] >> (blockNumber % 8)) & 1;
+}
+
+/*
+Take a slot of the i-node cache for another block : an empty one, else the least recently used
+clean one. When every block is dirty the changes so far are committed first.
+return : the slot, out of the hash chains
+*/
+int evictInodeSlot(){
+	int i, clean, block;
+	int victim = -1;
+	int* link;
+	
+	for (clean = 1; victim == -1; clean = 0){
+		for (i = 0; i < inodeSlots; i++){
+			if (inodeSlotBlock[i] == -1){
+				return i;
+			}
+			if (clean && dirtyMetadata[sb.inodeTableStart + inodeSlotBlock[i]]){
+				continue;
+			}
+			if (victim == -1 || inodeSlotUsed[i] < inodeSlotUsed[victim]){
+				victim = i;
+			}
+		}
+		if (victim == -1){
+			commitJournal();
+		}
+	}
+	
+	// the device failed the commit, the block goes to its place without the journal rather than be lost 
+	block = sb.inodeTableStart + inodeSlotBlock[victim];
+	if (dirtyMetadata[block]){
+		cache_write_blocks(block, 1, inodeCacheData + (size_t)victim * sb.block_size);
+		forgetMetadataDirty(block);
+	}
+	
+	link = &inodeBuckets[inodeSlotBlock[victim] & (numberOfInodeBuckets - 1)];
+	while (*link != victim){
+		link = &inodeSlotNext[*link];
+	}
+	*link = inodeSlotNext[victim];
+	inodeSlotBlock[victim] = -1;
+	return victim;
+}
+
+/*
+Block of the i-node file in the i-node cache, read from the disk on a miss
+block : block of the i-node file, counted from its start
+read : 0 if the caller overwrites the whole block
+return : the cached block
+*/
+void* getInodeBlock(int block, int read){
+	int slot = findInodeSlot(block);
+	
+	if (slot == -1){
+		slot = evictInodeSlot();
+		inodeSlotBlock[slot] = block;
+		inodeSlotNext[slot] = inodeBuckets[block & (numberOfInodeBuckets - 1)];
+		inodeBuckets[block & (numberOfInodeBuckets - 1)] = slot;
+		if (read){
+			cache_read_blocks(sb.inodeTableStart + block, 1, inodeCacheData + (size_t)slot * sb.block_size);
+		}
+	}
+	inodeSlotUsed[slot] = ++inodeClock;
+	return inodeCacheData + (size_t)slot * sb.block_size;
+}
+
+/*
+Return the cached i-node for an inode index. The pointer stays valid while the allocator lock is held
+and less than an i-node cache worth of other blocks is used.
+*/
+inode_t* getInode(int inodeIndex){
+	inode_t* inodes = getInodeBlock(inodeIndex / inodesPerBlock, 1);
+	return &inodes[inodeIndex % inodesPerBlock];
+}
+
+/*
+Size of a file, for callers without the allocator lock
+*/
+long long getInodeSize(int inodeIndex){
+	long long size;
+	
+	pthread_mutex_lock(&allocatorLock);
+	size = getInode(inodeIndex)->size;
+	pthread_mutex_unlock(&allocatorLock);
+	return size;
+}
+
+/*
+Initialize the i-node bit map with every i-node free but the root directory i-node
+*/
+void initializeIBM(){
+	int i;
+	memset(ibm, 0, (size_t)sb.ibmBlocks * sb.block_size);
+	
+	for (i = 1; i < sb.Inodes; i++){
+		ibm[i / 8] |= 1 << (i % 8);
+	}
+	ibmHint = 0;
+}
+
+/*
+Mark the i-node bit map block holding the bit of inodeIndex to be written back
+*/
+void writeIBMBlock(int inodeIndex){
+	markMetadataDirty(sb.ibmStart + inodeIndex / (8 * sb.block_size));
+}
+
+/*
+Set the i-node bit map bit of inodeIndex, 1 if the i-node is free
+*/
+void setIBMbit(int inodeIndex, int isFree){
+	if (isFree){
+		ibm[inodeIndex / 8] |= 1 << (inodeIndex % 8);
+		// a freed i-node may be before the first word with a free bit 
+		if (inodeIndex / 64 < ibmHint){
+			ibmHint = inodeIndex / 64;
+		}
+	}
+	else {
+		ibm[inodeIndex / 8] &= ~(1 << (inodeIndex % 8));
+	}
+	writeIBMBlock(inodeIndex);
+}
+
+/*
+Find a free i-node in the i-node bit map, scanned 64 i-nodes at a time like the free bit map.
+The i-node is taken by rootAddInode.
+return : the inode index between 0 and the number of i-nodes
+*/
+int findFreeInodeIndex(){
+	uint64_t* words = (uint64_t*)ibm;
+	int numberOfWords = (sb.Inodes + 63) / 64;
+	int i;
+	
+	// bits past the last i-node are never set 
+	for (i = ibmHint; i < numberOfWords; i++){
+		if (words[i] != 0){
+			ibmHint = i;
+			return i * 64 + __builtin_ctzll(words[i]);
+		}
+	}
+	
+	ibmHint = numberOfWords;
+	return -5;
+	
+}
+
+/*
+Mark the i-node block holding inodeIndex to be written back
+*/
+void writeInodeBlock(int inodeIndex){
+	markMetadataDirty(sb.inodeTableStart + inodeIndex / inodesPerBlock);
+}
+
+/*
+Read root directory blocks past the loaded ones into memory, none is kept if one can't be read
+from : first block, the first one not loaded
+to : block after the last one
+return : 0 or -1 if a block can't be read
+*/
+int readRootBlocks(int from, int to){
+	int i;
+	
+	for (i = from; i < to; i++){
+		rootDirectory[i] = malloc(sb.block_size);
+		if (rootDirectory[i] == NULL || cache_read_blocks(sb.rootDirectoryStart + i, 1, rootDirectory[i]) < 0){
+			for (; i >= from; i--){
+				free(rootDirectory[i]);
+				rootDirectory[i] = NULL;
+			}
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+Load the root directory blocks in use that aren't in memory yet and index them
+return : 0 or -1 if they can't be read
+*/
+int loadRootDirectory(){
+	int inUse = (int)(getInode(0)->size / sb.block_size);
+	
+	if (rootBlocksLoaded >= inUse){
+		return 0;
+	}
+	if (reserveDirectoryIndex(inUse) < 0){
+		return -1;
+	}
+	if (readRootBlocks(rootBlocksLoaded, inUse) == 0){
+		rootBlocksLoaded = inUse;
+	}
+	buildDirectoryIndex();
+	return rootBlocksLoaded == inUse ? 0 : -1;
+}
+
+/*
+Forget the loaded root directory blocks, the next lookup reads them again
+*/
+void dropRootDirectory(){
+	int i;
+	
+	for (i = 0; i < rootBlocksLoaded; i++){
+		free(rootDirectory[i]);
+		rootDirectory[i] = NULL;
+	}
+	rootBlocksLoaded = 0;
+	buildDirectoryIndex();
+}
+
+/*
+Mark the root directory block holding entry to be written back
+*/
+void writeDirectoryBlock(int entry){
+	markMetadataDirty(sb.rootDirectoryStart + entry / entriesPerBlock);
+}
+
+/*
+Add new inode into the free slot of the i-node File
+inodeIndex : inode index to place the new inode in the i-node File
+*/
+int rootAddInode(int inodeIndex){
+	int k;
+	inode_t newInode;
+	
+	if (getInode(inodeIndex)->size != -1){
+		return -1;
+	}
+	
+	for (k = 0 ; k < numberOfDirect; k++){
+		newInode.direct[k] = -1;
+	}
+	newInode.indirect = -1;
+	newInode.doubleIndirect = -1;
+	newInode.tripleIndirect = -1;
+	newInode.size = 0;
+	
+	*getInode(inodeIndex) = newInode;
+	writeInodeBlock(inodeIndex);
+	setIBMbit(inodeIndex, 0);
+	return 1;
+}
+
+/*
+Allocate a pointer block with every block number set to -1
+return : the block number or -1 if the disk is full
+*/
+int newPointerBlock(){
+	int pointers[sb.block_size / sizeOfPointer];
+	int blockNumber = FBMGetFreeBit();
+	
+	if (blockNumber != -1){
+		memset(pointers, 0xFF, sb.block_size);
+		writeJournaledBlock(blockNumber, pointers);
+	}
+	return blockNumber;
+}
+
+/*
+Store a block number in a pointer block of a file's tree. A pointer block a snapshot holds
+is copied first, and the pointer to it in the block above changes the same way, up to the i-node.
+inodeIndex : i-node of the file
+top : pointer of the i-node to the top pointer block
+path : pointer blocks from the top of the tree down, updated to their copies
+slots : pointer changed in each block of the path
+depth : block of the path holding the pointer
+value : block number to store
+return : 0 or -1 if the disk is full
+*/
+int setTreePointer(int inodeIndex, int* top, int* path, int* slots, int depth, int value){
+	int pointers[sb.block_size / sizeOfPointer];
+	int copies[maxIndirectLevel];
+	int d, first;
+	
+	// allocate every copy before anything changes 
+	for (first = depth; first >= 0 && isSharedBlock(path[first]); first--){
+		copies[first] = FBMGetFreeBit();
+		if (copies[first] == -1){
+			for (d = first + 1; d <= depth; d++){
+				setFBMbit(copies[d]);
+			}
+			return -1;
+		}
+	}
+	
+	for (d = depth; d >= 0; d--){
+		readJournaledBlock(path[d], pointers);
+		pointers[slots[d]] = value;
+		if (d <= first){
+			writeJournaledBlock(path[d], pointers);
+			return 0;
+		}
+		// the snapshot keeps the old block, the live file system lets go of it 
+		writeJournaledBlock(copies[d], pointers);
+		setFBMbit(path[d]);
+		path[d] = copies[d];
+		value = copies[d];
+	}
+	*top = value;
+	writeInodeBlock(inodeIndex);
+	return 0;
+}
+
+/*
+Walk the block tree of a file to the pointer of its blockIndex-th block.
+The first numberOfDirect blocks are direct, the following ones sit under the single, double then triple indirect block.
+inodeIndex : i-node of the file
+blockIndex : block of the file, counted from the start of the file
+newBlock : block to store if the pointer is empty, missing pointer blocks are allocated on the way.
+           -1 only looks the block up
+replace : store newBlock even if the pointer is set
+return : the block number stored in the pointer or -1
+*/
+int mapDataBlock(int inodeIndex, int blockIndex, int newBlock, int replace){
+	inode_t* inode = getInode(inodeIndex);
+	long long perBlock = sb.block_size / sizeOfPointer;
+	long long n = blockIndex;
+	long long span = perBlock;
+	int pointers[perBlock];
+	int path[maxIndirectLevel];
+	int slots[maxIndirectLevel];
+	int* top;
+	int level, depth, child;
+	
+	if (blockIndex < 0){
+		return -1;
+	}
+	
+	if (n < numberOfDirect){
+		if ((inode->direct[n] == -1 || replace) && newBlock != -1){
+			inode->direct[n] = newBlock;
+			writeInodeBlock(inodeIndex);
+		}
+		return inode->direct[n];
+	}
+	n -= numberOfDirect;
+	
+	// pick the tree holding the block, span is the number of blocks under its top pointer block
+	top = &inode->indirect;
+	for (level = 1; n >= span; level++){
+		if (level == maxIndirectLevel){
+			return -1;
+		}
+		n -= span;
+		span *= perBlock;
+		top = level == 1 ? &inode->doubleIndirect : &inode->tripleIndirect;
+	}
+	
+	if (*top == -1){
+		if (newBlock == -1 || (*top = newPointerBlock()) == -1){
+			return -1;
+		}
+		writeInodeBlock(inodeIndex);
+	}
+	path[0] = *top;
+	
+	// one pointer block per level down to the data block 
+	for (depth = 0; depth < level; depth++){
+		span /= perBlock;
+		slots[depth] = (int)(n / span);
+		n %= span;
+		readJournaledBlock(path[depth], pointers);
+		child = pointers[slots[depth]];
+		
+		if (child == -1 || (replace && depth == level - 1)){
+			if (newBlock == -1){
+				return child;
+			}
+			child = depth == level - 1 ? newBlock : newPointerBlock();
+			if (child == -1){
+				return -1;
+			}
+			if (setTreePointer(inodeIndex, top, path, slots, depth, child) < 0){
+				if (depth < level - 1){
+					setFBMbit(child);
+				}
+				return -1;
+			}
+		}
+		if (depth < level - 1){
+			path[depth + 1] = child;
+		}
+	}
+	
+	return child;
+}
+
+/*
+Give the live file system its own copy of a file block a snapshot holds, before the block changes.
+The caller writes the whole new content of the block to the block returned.
+inodeIndex : i-node of the file
+blockIndex : block of the file
+blockNumber : data block the file has there
+return : the block to write to, blockNumber if no snapshot holds it, or -1 if the disk is full
+*/
+int unshareDataBlock(int inodeIndex, int blockIndex, int blockNumber){
+	int i;
+	int copy;
+	
+	if (blockNumber < 0 || !isSharedBlock(blockNumber)){
+		return blockNumber;
+	}
+	copy = FBMGetFreeBit();
+	if (copy == -1){
+		return -1;
+	}
+	if (mapDataBlock(inodeIndex, blockIndex, copy, 1) != copy){
+		setFBMbit(copy);
+		return -1;
+	}
+	setFBMbit(blockNumber);
+	
+	// block maps of the open descriptors of the file point to the copy now 
+	for (i = openDescriptors[openBucket(inodeIndex)]; i != -1; i = nextDescriptor[i]){
+		if (fdt[i].inode == inodeIndex && blockIndex < fdt[i].mapLength && fdt[i].blockMap[blockIndex] != -1){
+			fdt[i].blockMap[blockIndex] = copy;
+		}
+	}
+	return copy;
+}
+
+/*
+Find the data block holding the blockIndex-th block of a file.
+A missing block is allocated with the extent allocator, the rest of the extent is laid out
+behind it so the following blocks of the file are contiguous on the disk.
+inodeIndex : i-node of the file
+blockIndex : block of the file, counted from the start of the file
+allocate : number of blocks the caller is about to fill from blockIndex on, 0 to never allocate
+return : the data block number or -1
+*/
+int getDataBlock(int inodeIndex, int blockIndex, int allocate){
+	int k, start, length, blockNumber;
+	
+	// a file stored in its i-node has no block 
+	if (getInode(inodeIndex)->tripleIndirect == inlineData){
+		return -1;
+	}
+	blockNumber = mapDataBlock(inodeIndex, blockIndex, -1, 0);
+	if (blockNumber != -1 || !allocate){
+		return blockNumber;
+	}
+	
+	if (allocate == 1){
+		start = FBMGetFreeBit();
+		length = 1;
+	}
+	else {
+		start = FBMGetFreeRun(allocate, &length);
+	}
+	if (start == -1){
+		return -1;
+	}
+	
+	for (k = 0; k < length; k++){
+		// the file already has this block or can't grow, hand the rest of the extent back
+		if (mapDataBlock(inodeIndex, blockIndex + k, start + k, 0) != start + k){
+			if (k == 0){
+				setFBMbit(start);
+				return -1;
+			}
+			for (; k < length; k++){
+				setFBMbit(start + k);
+			}
+			break;
+		}
+	}
+	
+	return start;
+}
+
+/*
+Free a pointer block and every block under it
+blockNumber : pointer block, or data block when level is 0
+level : number of pointer block levels down to the data blocks
+*/
+void releaseBlockTree(int blockNumber, int level){
+	int p;
+	int pointers[sb.block_size / sizeOfPointer];
+	
+	if (level > 0){
+		readJournaledBlock(blockNumber, pointers);
+		for (p = 0; p < sb.block_size / sizeOfPointer; p++){
+			if (pointers[p] != -1){
+				releaseBlockTree(pointers[p], level - 1);
+			}
+		}
+	}
+	setFBMbit(blockNumber);
+}
+
+/*
+Free an i-node, its data blocks and its pointer blocks.
+*/
+void releaseInode(int inodeIndex){
+	int p;
+	inode_t* inode = getInode(inodeIndex);
+	
+	// the data of a small file goes with its i-node 
+	if (inode->tripleIndirect == inlineData){
+		memset(inode->direct, 0xFF, inlineDataSize);
+		inode->tripleIndirect = -1;
+	}
+	for(p = 0 ; p < numberOfDirect; p++){
+		if (inode->direct[p] != -1){
+			setFBMbit(inode->direct[p]);
+			inode->direct[p] = -1;
+		}
+	}
+	if (inode->indirect != -1){
+		releaseBlockTree(inode->indirect, 1);
+	}
+	if (inode->doubleIndirect != -1){
+		releaseBlockTree(inode->doubleIndirect, 2);
+	}
+	if (inode->tripleIndirect != -1){
+		releaseBlockTree(inode->tripleIndirect, 3);
+	}
+	inode->indirect = -1;
+	inode->doubleIndirect = -1;
+	inode->tripleIndirect = -1;
+	inode->size = -1;
+	writeInodeBlock(inodeIndex);
+	setIBMbit(inodeIndex, 1);
+}
+
+/*
+Move the data of a file stored in its i-node to a data block, before a write makes it too big
+inodeIndex : i-node of the file
+return : 0 or -1 if the disk is full
+*/
+int spillInlineData(int inodeIndex){
+	unsigned char block[sb.block_size];
+	inode_t* inode = getInode(inodeIndex);
+	long long size = inode->size;
+	int blockNumber;
+	
+	memset(block, 0, sb.block_size);
+	memcpy(block, inode->direct, size);
+	memset(inode->direct, 0xFF, inlineDataSize);
+	inode->tripleIndirect = -1;
+	writeInodeBlock(inodeIndex);
+	if (size == 0){
+		return 0;
+	}
+	
+	blockNumber = getDataBlock(inodeIndex, 0, 1);
+	if (blockNumber == -1){
+		// keep the file in its i-node 
+		inode = getInode(inodeIndex);
+		memcpy(inode->direct, block, size);
+		inode->tripleIndirect = inlineData;
+		return -1;
+	}
+	cache_write_blocks(blockNumber, 1, block);
+	return 0;
+}
+
+/*
+Empty the dentry cache, i-node numbers are meaningless once another disk is made or mounted
+*/
+void clearDentryCache(){
+	int i;
+	for (i = 0; i < dentryCacheSize; i++){
+		dentryCache[i].parent = -1;
+	}
+}
+
+/*
+Dentry cache slot for a name in a directory
+*/
+dentry_t* getDentry(int dirInode, char* name){
+	return &dentryCache[(hashName(name) ^ (unsigned int)dirInode * 2654435761u) % dentryCacheSize];
+}
+
+/*
+Forget a cached lookup after its entry is removed
+*/
+void invalidateDentry(int dirInode, char* name){
+	dentry_t* dentry = getDentry(dirInode, name);
+	if (dentry->parent == dirInode && strncmp(dentry->entry.name, name, maxNameLength) == 0){
+		dentry->parent = -1;
+	}
+}
+
+/*
+Scan the entries of a directory from a slot on. The root directory lives in its own region,
+other directories keep their entries in their data blocks, read a block at a time.
+dirInode : i-node of the directory
+slot : first slot to look at
+name : entry name to look for, NULL for the first used entry
+freeSlot : look for the first free entry instead
+entry : set to the entry found
+return : slot of the entry or -1
+*/
+int scanDirectory(int dirInode, int slot, char* name, int freeSlot, directoryEntry_t* entry){
+	int count = dirInode == 0 ? rootBlocksLoaded * entriesPerBlock : (int)(getInode(dirInode)->size / sizeof(directoryEntry_t));
+	int loaded = -1;
+	int blockNumber;
+	directoryEntry_t block[entriesPerBlock];
+	directoryEntry_t* e;
+	
+	for (; slot < count; slot++){
+		if (dirInode == 0){
+			e = rootEntry(slot);
+		}
+		else {
+			if (slot / entriesPerBlock != loaded){
+				loaded = slot / entriesPerBlock;
+				blockNumber = getDataBlock(dirInode, loaded, 0);
+				if (blockNumber < 0){
+					return -1;
+				}
+				readJournaledBlock(blockNumber, block);
+			}
+			e = &block[slot % entriesPerBlock];
+		}
+		
+		if (freeSlot ? e->inodeIndex == -1 : e->inodeIndex != -1 && (name == NULL || strncmp(e->name, name, maxNameLength) == 0)){
+			*entry = *e;
+			return slot;
+		}
+	}
+	return -1;
+}
+
+/*
+Write a directory entry back, a slot past the end of a sub directory grows it
+return : 0 or -1 if the directory can't grow
+*/
+int writeDirectoryEntry(int dirInode, int slot, directoryEntry_t* entry){
+	int blockNumber;
+	unsigned char block[sb.block_size];
+	inode_t* inode;
+	
+	if (dirInode == 0){
+		*rootEntry(slot) = *entry;
+		writeDirectoryBlock(slot);
+		return 0;
+	}
+	
+	blockNumber = getDataBlock(dirInode, slot / entriesPerBlock, 1);
+	if (blockNumber < 0){
+		return -1;
+	}
+	readJournaledBlock(blockNumber, block);
+	memcpy(block + (slot % entriesPerBlock) * sizeof(directoryEntry_t), entry, sizeof(directoryEntry_t));
+	blockNumber = unshareDataBlock(dirInode, slot / entriesPerBlock, blockNumber);
+	if (blockNumber < 0){
+		return -1;
+	}
+	writeJournaledBlock(blockNumber, block);
+	
+	inode = getInode(dirInode);
+	if ((slot + 1) * (int)sizeof(directoryEntry_t) > inode->size){
+		inode->size = (slot + 1) * sizeof(directoryEntry_t);
+		writeInodeBlock(dirInode);
+	}
+	return 0;
+}
+
+/*
+Look a name up in a directory, through the dentry cache
+dirInode : i-node of the directory
+name : entry name
+entry : set to the entry found
+return : slot of the entry or -1
+*/
+int lookupEntry(int dirInode, char* name, directoryEntry_t* entry){
+	int slot;
+	dentry_t* dentry = getDentry(dirInode, name);
+	
+	if (dentry->parent == dirInode && strncmp(dentry->entry.name, name, maxNameLength) == 0){
+		*entry = dentry->entry;
+		return dentry->slot;
+	}
+	
+	// the root directory has its own hash index 
+	if (dirInode == 0){
+		slot = findEntrySlot(name);
+		if (slot != -1){
+			*entry = *rootEntry(slot);
+		}
+	}
+	else {
+		slot = scanDirectory(dirInode, 0, name, 0, entry);
+	}
+	
+	if (slot != -1){
+		dentry->parent = dirInode;
+		dentry->slot = slot;
+		dentry->entry = *entry;
+	}
+	return slot;
+}
+
+/*
+Split a path into its directory and its last component, every directory on the way must exist
+path : components of at most 10 characters separated by '/', a leading '/' is ignored
+name : set to the last component, holds 11 characters
+return : i-node of the directory holding the last component or -1
+*/
+int resolvePath(char* path, char* name){
+	directoryEntry_t entry;
+	int dirInode = 0;
+	int length;
+	char* end;
+	
+	// no disk is mounted 
+	if (rootDirectory == NULL || loadRootDirectory() < 0){
+		return -1;
+	}
+	if (*path == '/'){
+		path++;
+	}
+	
+	while (1){
+		end = strchr(path, '/');
+		length = end == NULL ? (int)strlen(path) : (int)(end - path);
+		if (length == 0 || length > maxNameLength){
+			return -1;
+		}
+		memset(name, 0, maxNameLength + 1);
+		memcpy(name, path, length);
+		
+		if (end == NULL){
+			return dirInode;
+		}
+		if (lookupEntry(dirInode, name, &entry) == -1 || entry.type != entryDirectory){
+			return -1;
+		}
+		dirInode = entry.inodeIndex;
+		path = end + 1;
+	}
+}
+
+/*
+Find the i-node of a directory from its path, "/" or "" is the root directory
+return : i-node of the directory or -1
+*/
+int resolveDirectory(char* path){
+	char name[maxNameLength + 1];
+	directoryEntry_t entry;
+	int dirInode;
+	
+	if (rootDirectory != NULL && (strcmp(path, "") == 0 || strcmp(path, "/") == 0)){
+		return loadRootDirectory() < 0 ? -1 : 0;
+	}
+	dirInode = resolvePath(path, name);
+	if (dirInode == -1 || lookupEntry(dirInode, name, &entry) == -1 || entry.type != entryDirectory){
+		return -1;
+	}
+	return entry.inodeIndex;
+}
+
+/*
+Add the next block of the root directory region once every slot is taken. Its entries are all free whatever
+the disk holds, the block and the size of the root i-node counting it are committed together.
+return : 0 or -1 if the region is full
+*/
+int growRootDirectory(){
+	int block = rootBlocksLoaded;
+	int rebuild;
+	int i;
+	
+	if (block == sb.rootDirectoryBlocks){
+		return -1;
+	}
+	rebuild = reserveDirectoryIndex(block + 1);
+	if (rebuild < 0){
+		return -1;
+	}
+	rootDirectory[block] = malloc(sb.block_size);
+	if (rootDirectory[block] == NULL){
+		if (rebuild){
+			buildDirectoryIndex();
+		}
+		return -1;
+	}
+	initializeRootBlock(rootDirectory[block]);
+	rootBlocksLoaded++;
+	markMetadataDirty(sb.rootDirectoryStart + block);
+	getInode(0)->size = (long long)rootBlocksLoaded * sb.block_size;
+	writeInodeBlock(0);
+	
+	// the free slot stack is empty, the lowest new slot goes on top 
+	if (rebuild){
+		buildDirectoryIndex();
+	}
+	else {
+		for (i = rootBlocksLoaded * entriesPerBlock - 1; i >= block * entriesPerBlock; i--){
+			freeEntries[freeEntryCount++] = i;
+		}
+	}
+	return 0;
+}
+
+/*
+create a new file or directory by taking a free i-node and adding a new entry to a free slot of its directory
+dirInode : i-node of the directory
+name : name of the entry, must not exist in the directory
+type : entryFile or entryDirectory
+return : the i-node of the new entry or -1
+*/
+int createEntry(int dirInode, char* name, int type){
+	int slot;
+	directoryEntry_t entry;
+	int inodeIndex = findFreeInodeIndex();
+	
+	if (inodeIndex < 0){
+		return -1;
+	}
+	
+	if (dirInode == 0){
+		if (freeEntryCount == 0 && growRootDirectory() < 0){
+			return -1;
+		}
+		slot = freeEntries[freeEntryCount - 1];
+	}
+	else {
+		// reuse a removed entry or append one 
+		slot = scanDirectory(dirInode, 0, NULL, 1, &entry);
+		if (slot == -1){
+			slot = (int)(getInode(dirInode)->size / sizeof(directoryEntry_t));
+		}
+	}
+	
+	// take the i-node, it is given back if the directory can't grow. A new file starts in its i-node
+	rootAddInode(inodeIndex);
+	if (type == entryFile){
+		getInode(inodeIndex)->tripleIndirect = inlineData;
+	}
+	
+	memset(&entry, 0, sizeof(entry));
+	strncpy(entry.name, name, maxNameLength);
+	entry.type = type;
+	entry.inodeIndex = inodeIndex;
+	if (writeDirectoryEntry(dirInode, slot, &entry) < 0){
+		releaseInode(inodeIndex);
+		return -1;
+	}
+	if (dirInode == 0){
+		freeEntryCount--;
+		addEntrySlot(slot);
+	}
+	return inodeIndex;
+}
+
+/*
+Remove an entry from its directory, the caller releases its i-node
+*/
+void removeEntry(int dirInode, int slot, directoryEntry_t* entry){
+	directoryEntry_t empty;
+	
+	invalidateDentry(dirInode, entry->name);
+	memset(&empty, 0, sizeof(empty));
+	empty.inodeIndex = -1;
+	empty.type = entryFile;
+	
+	if (dirInode == 0){
+		removeEntrySlot(slot);
+		strcpy(empty.name, "root/");
+	}
+	writeDirectoryEntry(dirInode, slot, &empty);
+}
+
+/*
+Clear the bits of a block bit map outside the data blocks
+*/
+void clearMetadataBits(unsigned char* map){
+	int i;
+	
+	for (i = 0; i < sb.dataStart; i++){
+		map[i / 8] &= ~(1 << (i % 8));
+	}
+	for (i = sb.fs_size; i < sb.fbmBlocks * 8 * sb.block_size; i++){
+		map[i / 8] &= ~(1 << (i % 8));
+	}
+}
+
+/*
+Copy a snapshot over the live file system, once the snapshot is recorded in the super block : an i-node file
+bigger than the i-node cache or a change bigger than the journal is committed in several transactions,
+a crash between them leaves the record for the next mount to start over
+id : snapshot to bring back
+*/
+void restoreSnapshot(int id){
+	int i, k, inUse;
+	int start = sb.shadow[id].direct[0];
+	inode_t* inodes;
+	size_t b;
+	size_t bytes = (size_t)sb.fbmBlocks * sb.block_size;
+	
+	// the live file system uses the blocks the snapshot holds, but its image 
+	for (b = 0; b < bytes; b++){
+		fbm[b] = ~snapshotBlocks[id][b];
+	}
+	clearMetadataBits(fbm);
+	for (i = start; i < start + snapshotImageBlocks(&sb); i++){
+		fbm[i / 8] |= 1 << (i % 8);
+	}
+	fbmHint = 0;
+	for (i = sb.fbmStart; i < sb.rootDirectoryStart; i++){
+		markMetadataDirty(i);
+	}
+	
+	// a block the image doesn't hold a copy of is unchanged since the snapshot, so are its i-nodes' bits 
+	for (i = 0; i < sb.inodeTableBlocks; i++){
+		if (!isCopiedToImage(id, i)){
+			continue;
+		}
+		inodes = getInodeBlock(i, 0);
+		cache_read_blocks(start + i, 1, inodes);
+		markMetadataDirty(sb.inodeTableStart + i);
+		for (k = 0; k < inodesPerBlock && i * inodesPerBlock + k < sb.Inodes; k++){
+			setIBMbit(i * inodesPerBlock + k, inodes[k].size == -1);
+		}
+	}
+	
+	// the root i-node of the snapshot counts the root directory blocks it used, the ones past them are free 
+	dropRootDirectory();
+	inUse = (int)(getInode(0)->size / sb.block_size);
+	if (reserveDirectoryIndex(inUse) >= 0 && readRootBlocks(0, inUse) == 0){
+		rootBlocksLoaded = inUse;
+	}
+	for (i = 0; i < rootBlocksLoaded; i++){
+		if (isCopiedToImage(id, sb.inodeTableBlocks + i)){
+			cache_read_blocks(start + sb.inodeTableBlocks + i, 1, rootDirectory[i]);
+			markMetadataDirty(sb.rootDirectoryStart + i);
+		}
+	}
+	buildDirectoryIndex();
+	clearDentryCache();
+}
+
+/*
+Commit a restored snapshot then drop the record of the rollback, alone so it only reaches the disk after
+everything the rollback changed
+return : 0 or -1 if the journal could not be written
+*/
+int finishRollback(){
+	if (commitJournal() < 0){
+		return -1;
+	}
+	sb.rollbackShadow = -1;
+	markMetadataDirty(0);
+	if (commitJournal() < 0){
+		return -1;
+	}
+	// the blocks the rollback freed may be in transactions still in the journal 
+	return checkpointJournal();
+}
+
+/*
+Leave nothing mounted after a disk that can't be mounted, the calls that follow fail
+*/
+void rejectDisk(){
+	int i;
+	
+	releaseTables();
+	memset(&sb, 0, sizeof(sb));
+	for (i = 0; i < numberOfShadows; i++){
+		sb.shadow[i].size = -1;
+	}
+	sb.lastShadow = -1;
+	sb.rollbackShadow = -1;
+	clearDentryCache();
+}
+
+/*
+Pick the disk backend of the next mkssfs or mkssfs_geometry, a disk made with one mounts with the other
+backend : DISK_BACKEND_FILE or DISK_BACKEND_MMAP
+return : 0 or -1 if there is no such backend
+*/
+int ssfs_disk_backend(int backend){
+	if (backend != DISK_BACKEND_FILE && backend != DISK_BACKEND_MMAP){
+		return -1;
+	}
+	diskBackend = backend;
+	return 0;
+}
+
+/*
+make a fresh shadow file system with a chosen geometry
+blockSize : bytes per block, a power of 2 between 512 and 65536
+numberOfBlocks : blocks on the disk
+numberOfInodes : maximum number of files and directories
+return : 0 or -1 if the geometry is invalid or the disk can't be created
+*/
+int mkssfs_geometry(int blockSize, int numberOfBlocks, int numberOfInodes){
+	//create a new file system
+	char* filename = "WDDNGUYEN";
+	
+	// metadata of a previous mount is committed to its disk before it is closed 
+	commitJournal();
+	if (initializeSuperBlock(blockSize, numberOfBlocks, numberOfInodes) < 0){
+		return -1;
+	}
+	
+	// dirty blocks of a previous mount reach their disk before it is closed
+	init_cache(blockSize, cacheCapacity);
+	set_disk_backend(diskBackend);
+	registerJournalExit();
+	
+	if (allocateTables() < 0){
+		rejectDisk();
+		return -1;
+	}
+	initializeFBM();
+	initializeIBM();
+	buildDirectoryIndex();
+	clearDentryCache();
+	initializeFileDescriptorTable();
+	
+	if (init_fresh_disk(filename, blockSize, numberOfBlocks) < 0){
+		rejectDisk();
+		return -1;
+	}
+	
+	// the cache is empty, metadata regions are written straight to the new disk 
+	unsigned char super[blockSize];
+	memset(super, 0, blockSize);
+	memcpy(super, &sb, sizeof(sb));
+	write_blocks(0, 1, super);
+	write_blocks(sb.fbmStart, sb.fbmBlocks, fbm);
+	write_blocks(sb.ibmStart, sb.ibmBlocks, ibm);
+	initializeInodeFiles();
+	journalSequence = 1;
+	journalHead = 1;
+	checkpointPending = writeJournalSuper(journalSequence) < 0;
+	journalOps = 0;
+	journalOwner = getpid();
+	return 0;
+}
+
+/*
+make a shadow file system
+fresh : if fresh > 0 then initialize the disk with the default geometry else recover persistance values in the disk 
+*/
+void mkssfs(int fresh){
+		
+	if (fresh){
+		mkssfs_geometry(defaultBlockSize, defaultNumberOfBlocks, defaultNumberOfInodes);
+	}
+	// Shadow file system already exist 
+	else {
+	
+	char* filename = "WDDNGUYEN";
+	unsigned char super[minBlockSize];
+	superblock_t disk;
+	
+	// flush and drop the cache, its block size may not be the one of this disk
+	commitJournal();
+	init_cache(0, 0);
+	set_disk_backend(diskBackend);
+	
+	// open super block, it fits in the smallest block size and gives the geometry 
+	if (init_disk(filename, minBlockSize, 1) < 0 || read_blocks(0, 1, super) < 0){
+		rejectDisk();
+		return;
+	}
+	memcpy(&disk, super, sizeof(disk));
+	if (checkSuperBlock(&disk) < 0){
+		printf("%s doesn't hold a file system of this format\n", filename);
+		rejectDisk();
+		return;
+	}
+	sb = disk;
+	init_disk(filename, sb.block_size, sb.fs_size);
+	
+	// redo committed metadata a crash kept from reaching home, before anything is read 
+	replayJournal();
+	{
+		unsigned char block[sb.block_size];
+		// a snapshot change may have been replayed into the super block
+		read_blocks(0, 1, block);
+		memcpy(&disk, block, sizeof(disk));
+		if (checkSuperBlock(&disk) < 0 || disk.block_size != sb.block_size || disk.fs_size != sb.fs_size){
+			rejectDisk();
+			return;
+		}
+		sb = disk;
+	}
+	init_cache(sb.block_size, cacheCapacity);
+	registerJournalExit();
+	
+	if (allocateTables() < 0){
+		rejectDisk();
+		return;
+	}
+	initializeFileDescriptorTable();
+	
+	// open FBM 
+	read_blocks(sb.fbmStart, sb.fbmBlocks, fbm);
+	fbmHint = 0;
+	// open i-node bit map 
+	read_blocks(sb.ibmStart, sb.ibmBlocks, ibm);
+	ibmHint = 0;
+	// i-node and root directory blocks are read when first used 
+	clearDentryCache();
+	loadSnapshots();
+	journalOps = 0;
+	journalOwner = getpid();
+	
+	// a rollback the last session left half way 
+	if (sb.rollbackShadow != -1){
+		if (snapshotBlocks[sb.rollbackShadow] == NULL || snapshotCopies[sb.rollbackShadow] == NULL){
+			rejectDisk();
+			return;
+		}
+		restoreSnapshot(sb.rollbackShadow);
+		finishRollback();
+	}
+	}
+ 
+}
+
+/*
+Free a file descriptor table entry and drop its block map
+*/
+void releaseFileDescriptor(int fileID){
+	int* link = &openDescriptors[openBucket(fdt[fileID].inode)];
+	
+	// unlink it from the descriptors of its file and give it back to the free stack 
+	while (*link != fileID){
+		link = &nextDescriptor[*link];
+	}
+	*link = nextDescriptor[fileID];
+	freeDescriptors[freeDescriptorCount++] = fileID;
+	
+	free(fdt[fileID].blockMap);
+	fdt[fileID].blockMap = NULL;
+	fdt[fileID].mapLength = 0;
+	fdt[fileID].inode = -1;
+	fdt[fileID].rwptr = 0;
+	fdt[fileID].readptr = 0;
+	fdt[fileID].free = -1;
+	resetAccessPattern(fileID);
+}
+
+/*
+Lock an open file descriptor then the i-node of its file, shared by readers or held by one writer.
+The caller holds fileSystemLock.
+fileID : file descriptor table index
+write : 1 to change the file, 0 to read it
+return : 0 or -1 if fileID is not open
+*/
+int lockDescriptor(int fileID, int write){
+	if (fileID < 0 || fileID >= numberOfLocks){
+		return -1;
+	}
+	pthread_mutex_lock(&descriptorLocks[fileID]);
+	if (fdt[fileID].inode == -1){
+		pthread_mutex_unlock(&descriptorLocks[fileID]);
+		return -1;
+	}
+	if (write){
+		pthread_rwlock_wrlock(inodeLock(fdt[fileID].inode));
+	}
+	else {
+		pthread_rwlock_rdlock(inodeLock(fdt[fileID].inode));
+	}
+	return 0;
+}
+
+void unlockDescriptor(int fileID){
+	pthread_rwlock_unlock(inodeLock(fdt[fileID].inode));
+	pthread_mutex_unlock(&descriptorLocks[fileID]);
+}
+
+/*
+lockDescriptor under a shared hold of the file system
+*/
+int lockFile(int fileID, int write){
+	pthread_rwlock_rdlock(&fileSystemLock);
+	if (lockDescriptor(fileID, write) < 0){
+		pthread_rwlock_unlock(&fileSystemLock);
+		return -1;
+	}
+	return 0;
+}
+
+void unlockFile(int fileID){
+	unlockDescriptor(fileID);
+	pthread_rwlock_unlock(&fileSystemLock);
+}
+
+/*
+Lock the directories and the metadata, for operations on names
+*/
+void lockDirectories(){
+	pthread_rwlock_rdlock(&fileSystemLock);
+	pthread_mutex_lock(&directoryLock);
+	pthread_mutex_lock(&allocatorLock);
+}
+
+void unlockDirectories(){
+	pthread_mutex_unlock(&allocatorLock);
+	pthread_mutex_unlock(&directoryLock);
+	pthread_rwlock_unlock(&fileSystemLock);
+}
+
+/*
+Hold the file system alone, once the calls in flight are done, for snapshots.
+Every other call holds fileSystemLock shared, the allocator lock only keeps out the exit commit.
+*/
+void lockEverything(){
+	pthread_rwlock_wrlock(&fileSystemLock);
+	pthread_mutex_lock(&allocatorLock);
+}
+
+void unlockEverything(){
+	pthread_mutex_unlock(&allocatorLock);
+	pthread_rwlock_unlock(&fileSystemLock);
+}
+
+/*
+Find the data block of an open file through its block map, the map is filled as blocks are looked up
+fileID : file descriptor table index
+blockIndex : block of the file, counted from the start of the file
+allocate : same as getDataBlock
+return : the data block number or -1
+*/
+int getFileBlock(int fileID, int blockIndex, int allocate){
+	fileDescriptor_t* fd = &fdt[fileID];
+	int length, blockNumber;
+	int* map;
+	
+	if (blockIndex < fd->mapLength && fd->blockMap[blockIndex] != -1){
+		return fd->blockMap[blockIndex];
+	}
+	
+	pthread_mutex_lock(&allocatorLock);
+	blockNumber = getDataBlock(fd->inode, blockIndex, allocate);
+	pthread_mutex_unlock(&allocatorLock);
+	if (blockNumber == -1 || blockIndex < 0){
+		return blockNumber;
+	}
+	
+	// grow the map to cover the block, doubling keeps sequential growth cheap 
+	if (blockIndex >= fd->mapLength){
+		length = fd->mapLength == 0 ? 16 : fd->mapLength;
+		while (length <= blockIndex){
+			length *= 2;
+		}
+		map = realloc(fd->blockMap, sizeof(int) * length);
+		if (map == NULL){
+			return blockNumber;
+		}
+		memset(map + fd->mapLength, 0xFF, sizeof(int) * (length - fd->mapLength));
+		fd->blockMap = map;
+		fd->mapLength = length;
+	}
+	fd->blockMap[blockIndex] = blockNumber;
+	return blockNumber;
+}
+
+/*
+Find a file by its path, a file that doesn't exist is created in its directory
+name : path of the file
+return : i-node of the file or -1
+*/
+int lookupOrCreateFile(char *name){
+	int inodeIndex = -1;
+	char fileName[maxNameLength + 1];
+	directoryEntry_t entry;
+	
+	// directory of the file, fails if a component is too big or a directory is missing
+	int dirInode = resolvePath(name, fileName);
+	if (dirInode == -1){
+		return -1;
+	}
+	
+	// search the directory for file name
+	if (lookupEntry(dirInode, fileName, &entry) != -1){
+		if (entry.type == entryDirectory){
+			return -1;
+		}
+		inodeIndex = entry.inodeIndex;
+	}
+	// if doesnt exist then create a new file 
+	else {
+		inodeIndex = createEntry(dirInode, fileName, entryFile);
+		endTransaction();
+		if (inodeIndex == -1){
+			printf("too many files in directory");
+			return -1;
+		}
+	}
+	return inodeIndex;
+}
+
+/*
+Open a file by checking if file exist in the root directory and place the file in a file descriptor table when writing/reading
+if file doesn't exist, create a new file, add into the root directory then place the file in the file descriptor table. 
+Every open takes a new descriptor with its own read and write pointers, a file may be open many times.
+name : name of the file to open .
+return : file descriptor index
+*/
+int ssfs_fopen(char *name){
+	int i;
+	int inodeIndex;
+	
+	pthread_rwlock_rdlock(&fileSystemLock);
+	pthread_mutex_lock(&directoryLock);
+	pthread_mutex_lock(&allocatorLock);
+	inodeIndex = lookupOrCreateFile(name);
+	pthread_mutex_unlock(&allocatorLock);
+	if (inodeIndex == -1){
+		pthread_mutex_unlock(&directoryLock);
+		pthread_rwlock_unlock(&fileSystemLock);
+		return -1;
+	}
+	
+	// take a free descriptor, every open gets its own offsets 
+	if (freeDescriptorCount == 0){
+		pthread_mutex_unlock(&directoryLock);
+		pthread_rwlock_unlock(&fileSystemLock);
+		return -1;
+	}
+	i = freeDescriptors[--freeDescriptorCount];
+	
+	// the descriptors of a file change only with the file locked for writing 
+	pthread_mutex_lock(&descriptorLocks[i]);
+	pthread_rwlock_wrlock(inodeLock(inodeIndex));
+	fdt[i].inode = inodeIndex;
+	fdt[i].free = 0;
+	fdt[i].readptr = 0;
+	// a file open elsewhere is written at its end 
+	fdt[i].rwptr = openDescriptorOf(inodeIndex) == -1 ? 0 : getInodeSize(inodeIndex);
+	resetAccessPattern(i);
+	fdt[i].lastWriteEnd = fdt[i].rwptr;
+	fdt[i].writeBehindStart = (int)(fdt[i].rwptr / sb.block_size);
+	nextDescriptor[i] = openDescriptors[openBucket(inodeIndex)];
+	openDescriptors[openBucket(inodeIndex)] = i;
+	unlockDescriptor(i);
+	pthread_mutex_unlock(&directoryLock);
+	pthread_rwlock_unlock(&fileSystemLock);
+	return i;
+	
+}
+/*
+Close the file descriptor table. The close ends an operation of the group commit, ssfs_sync makes it durable
+fileID : the index of the file descriptor table
+return : 0 or -1 if the file is not open or the group commit it completed failed
+*/
+
+int ssfs_fclose(int fileID){
+	int inodeIndex;
+	int ret;
+	
+	//invalid fileID or file ID is not open, reads and writes in flight finish first
+	pthread_rwlock_rdlock(&fileSystemLock);
+	pthread_mutex_lock(&directoryLock);
+	if (lockDescriptor(fileID, 1) < 0){
+		pthread_mutex_unlock(&directoryLock);
+		pthread_rwlock_unlock(&fileSystemLock);
+		return -1;
+	}
+	// remove fdt open file
+	inodeIndex = fdt[fileID].inode;
+	releaseFileDescriptor(fileID);
+	pthread_rwlock_unlock(inodeLock(inodeIndex));
+	pthread_mutex_unlock(&descriptorLocks[fileID]);
+	pthread_mutex_unlock(&directoryLock);
+	
+	// the descriptor is gone even if the commit fails 
+	pthread_mutex_lock(&allocatorLock);
+	ret = endTransaction();
+	pthread_mutex_unlock(&allocatorLock);
+	pthread_rwlock_unlock(&fileSystemLock);
+	return ret < 0 ? -1 : 0;	
+	
+}
+
+/*
+Write every dirty cached block back and make the disk durable
+*/
+int ssfs_sync(){
+	int ret = 0;
+	
+	pthread_rwlock_rdlock(&fileSystemLock);
+	pthread_mutex_lock(&allocatorLock);
+	// a commit writes the file data and the journal then syncs, its metadata is written home after it
+	if (dirtyMetadataCount + journaledBlockCount > 0){
+		if (commitJournal() < 0 || flush_cache() < 0){
+			ret = -1;
+		}
+	}
+	else if (flush_cache() < 0 || sync_disk() < 0){
+		ret = -1;
+	}
+	pthread_mutex_unlock(&allocatorLock);
+	pthread_rwlock_unlock(&fileSystemLock);
+	return ret;
+}
+
+/*
+size of an open file
+fileID : file descriptor table index
+return : size in bytes or -1
+*/
+long long fileSize(int fileID){
+	if(fileID < 0 || fileID >= fdtSize || fdt[fileID].free == -1){
+		return -1;
+	}
+	return getInodeSize(fdt[fileID].inode);
+}
+
+/*
+ssfs_fsize with the file locked for reading
+*/
+long long ssfs_fsize(int fileID){
+	long long ret;
+	
+	if (lockFile(fileID, 0) < 0){
+		return -1;
+	}
+	ret = fileSize(fileID);
+	unlockFile(fileID);
+	return ret;
+}
+
+/*
+seek the read pointer of the file descriptor table to the specific byte location
+fileID : file descriptor table index
+loc : byte location for read pointer to be placed.
+*/
+int seekRead(int fileID, long long loc){
+	// check if fileID is valid
+	
+	if (loc < 0){
+		return -1;
+	}
+	
+	if(fileID < 0 || fileID >= fdtSize){
+		return -1;
+	}
+	
+	
+	if (fdt[fileID].free == -1){
+		return -1;
+	}
+	
+	// location can't be bigger than size 
+	if(loc > getInodeSize(fdt[fileID].inode)){
+		return -1;
+	}
+	
+	fdt[fileID].readptr = loc;
+	return 0;
+	
+}
+
+/*
+ssfs_frseek with the file locked for reading
+*/
+int ssfs_frseek(int fileID, long long loc){
+	int ret;
+	
+	if (lockFile(fileID, 0) < 0){
+		return -1;
+	}
+	ret = seekRead(fileID, loc);
+	unlockFile(fileID);
+	return ret;
+}
+
+/*
+seek the write pointer of the file descriptor table to the specific byte location
+fileID : file descriptor table index
+loc : byte location for write pointer to be placed.
+*/
+
+int seekWrite(int fileID, long long loc){
+	
+	// check if fileID is valid
+	
+	if (loc < 0){
+		return -1;
+	}
+	
+	if(fileID < 0 || fileID >= fdtSize){
+		return -1;
+	}
+	
+	
+	if (fdt[fileID].free == -1){
+		return -1;
+	}
+	
+	if(loc > getInodeSize(fdt[fileID].inode)){
+		return -1;
+	}
+	
+	fdt[fileID].rwptr = loc;
+	return 0;
+}
+
+/*
+ssfs_fwseek with the file locked for reading
+*/
+int ssfs_fwseek(int fileID, long long loc){
+	int ret;
+	
+	if (lockFile(fileID, 0) < 0){
+		return -1;
+	}
+	ret = seekWrite(fileID, loc);
+	unlockFile(fileID);
+	return ret;
+}
+/*
+writing inside the data blocks of a file
+a small file is written in its i-node until the write pointer moves past inlineDataSize
+data blocks are allocated as the write pointer moves past the last block of the file
+blocks overwritten completely are gathered and written with a single vectored write,
+only the partial first and last blocks are read before being written
+fileID: file in the open descriptor table
+buf : buffer to write from 
+length : number of bytes to write 
+return : length written
+*/
+
+int writeFile(int fileID, char *buf, int length){
+	
+	if(fileID < 0 || fileID >= fdtSize){
+		return -1;
+	}
+	
+	// verify if file ID exist 
+	if (fdt[fileID].inode == -1 || length < 0){
+		return -1;
+	}
+	
+	if (length == 0){
+		return 0;
+	}
+	
+	fileDescriptor_t* fd = &fdt[fileID];
+	int inodeIndex = fdt[fileID].inode;
+	long long start = fdt[fileID].rwptr;
+	inode_t* inode;
+	
+	// block indexes of a file are int, that is 2^31 blocks 
+	if ((start + length - 1) / sb.block_size > INT_MAX){
+		return -1;
+	}
+	
+	pthread_mutex_lock(&allocatorLock);
+	inode = getInode(inodeIndex);
+	if (inode->tripleIndirect == inlineData){
+		// still small, no data block to write 
+		if (start + length <= inlineDataSize){
+			memcpy((char*)inode->direct + start, buf, length);
+			fd->rwptr += length;
+			if (fd->rwptr > inode->size){
+				inode->size = fd->rwptr;
+			}
+			writeInodeBlock(inodeIndex);
+			endTransaction();
+			pthread_mutex_unlock(&allocatorLock);
+			return length;
+		}
+		if (spillInlineData(inodeIndex) < 0){
+			endTransaction();
+			pthread_mutex_unlock(&allocatorLock);
+			return -1;
+		}
+	}
+	pthread_mutex_unlock(&allocatorLock);
+	
+	int firstBlock = (int)(start / sb.block_size);
+	int lastBlock = (int)((start + length - 1) / sb.block_size);
+	int blockCount = lastBlock - firstBlock + 1;
+	int *fullBlocks = malloc(sizeof(int) * blockCount);
+	void **fullBuffers = malloc(sizeof(void *) * blockCount);
+	int fullCount = 0;
+	int written = 0;
+	int blockNumber, oldBlock, offset, chunk, n, k;
+	unsigned char write[sb.block_size];
+	
+	for (n = firstBlock; n <= lastBlock; n++){
+		blockNumber = getFileBlock(fileID, n, lastBlock - n + 1);
+		// disk or file is full 
+		if (blockNumber < 0){
+			break;
+		}
+		
+		// a block a snapshot holds is written to a copy, the snapshot keeps the old content in place 
+		oldBlock = blockNumber;
+		if (isSharedBlock(blockNumber)){
+			pthread_mutex_lock(&allocatorLock);
+			blockNumber = unshareDataBlock(inodeIndex, n, blockNumber);
+			pthread_mutex_unlock(&allocatorLock);
+			if (blockNumber < 0){
+				break;
+			}
+		}
+		
+		offset = (n == firstBlock) ? (int)(start % sb.block_size) : 0;
+		chunk = sb.block_size - offset;
+		if (chunk > length - written){
+			chunk = length - written;
+		}
+		
+		// whole block is replaced, write it straight from the caller's buffer 
+		if (chunk == sb.block_size){
+			fullBlocks[fullCount] = blockNumber;
+			fullBuffers[fullCount] = buf + written;
+			fullCount++;
+		}
+		else {
+			cache_read_blocks(oldBlock, 1, write);
+			memcpy(write + offset, buf + written, chunk);
+			cache_write_blocks(blockNumber, 1, write);
+		}
+		written += chunk;
+	}
+	
+	if (fullCount > 0){
+		cache_write_block_list(fullCount, fullBlocks, fullBuffers);
+	}
+	free(fullBlocks);
+	free(fullBuffers);
+	
+	if (written == 0){
+		pthread_mutex_lock(&allocatorLock);
+		endTransaction();
+		pthread_mutex_unlock(&allocatorLock);
+		return -1;
+	}
+	
+	// update pointer and size of the file 
+	pthread_mutex_lock(&allocatorLock);
+	fdt[fileID].rwptr += written;
+	if (fdt[fileID].rwptr > getInode(inodeIndex)->size){
+		getInode(inodeIndex)->size = fdt[fileID].rwptr;
+		writeInodeBlock(inodeIndex);
+	}
+	// allocation and size changes of the whole write reach the cache together
+	endTransaction();
+	pthread_mutex_unlock(&allocatorLock);
+	
+	// a sequential writer hands its finished blocks to the cache to write back together in the background
+	if (start != fd->lastWriteEnd){
+		fd->writeBehindStart = firstBlock;
+	}
+	fd->lastWriteEnd = fd->rwptr;
+	n = (int)(fd->rwptr / sb.block_size);
+	if (n - fd->writeBehindStart >= writeBehindBlocks){
+		fullCount = 0;
+		fullBlocks = malloc(sizeof(int) * (n - fd->writeBehindStart));
+		for (k = fd->writeBehindStart; k < n; k++){
+			blockNumber = getFileBlock(fileID, k, 0);
+			if (blockNumber >= 0){
+				fullBlocks[fullCount++] = blockNumber;
+			}
+		}
+		cache_write_behind(fullCount, fullBlocks);
+		free(fullBlocks);
+		fd->writeBehindStart = n;
+	}
+	return written;
+}
+
+/*
+ssfs_fwrite with the file locked for writing, writes to other files go on in parallel
+*/
+int ssfs_fwrite(int fileID, char *buf, int length){
+	int ret;
+	
+	if (lockFile(fileID, 1) < 0){
+		return -1;
+	}
+	ret = writeFile(fileID, buf, length);
+	unlockFile(fileID);
+	return ret;
+}
+
+/*
+Read inside the data blocks of a file, or the i-node of a small file
+blocks read completely are gathered and read with a single vectored read straight into buf
+fileID: file in the open descriptor table
+buf : buffer to read into
+length : number of bytes to read, reads stop at the end of the file
+return : length read
+*/
+
+int readFile(int fileID, char *buf, int length){
+	
+	// verify if file ID exist 
+	if(fileID < 0 || fileID >= fdtSize){
+		return -1;
+	}
+	
+	if (fdt[fileID].inode == -1 || length < 0){
+		return -1;
+	}
+	
+	fileDescriptor_t* fd = &fdt[fileID];
+	int inodeIndex = fdt[fileID].inode;
+	long long start = fdt[fileID].readptr;
+	long long size;
+	inode_t* inode;
+	
+	pthread_mutex_lock(&allocatorLock);
+	inode = getInode(inodeIndex);
+	size = inode->size;
+	
+	// can't read past the end of the file 
+	if (start + length > size){
+		length = size - start;
+	}
+	if (length <= 0){
+		pthread_mutex_unlock(&allocatorLock);
+		return 0;
+	}
+	
+	// a small file is read from the cached i-node without a block read 
+	if (inode->tripleIndirect == inlineData){
+		memcpy(buf, (char*)inode->direct + start, length);
+		pthread_mutex_unlock(&allocatorLock);
+		fd->readptr += length;
+		fd->lastReadEnd = fd->readptr;
+		return length;
+	}
+	pthread_mutex_unlock(&allocatorLock);
+	
+	int firstBlock = (int)(start / sb.block_size);
+	int lastBlock = (int)((start + length - 1) / sb.block_size);
+	int blockCount = lastBlock - firstBlock + 1;
+	int *fullBlocks = malloc(sizeof(int) * blockCount);
+	void **fullBuffers = malloc(sizeof(void *) * blockCount);
+	int fullCount = 0;
+	int readLength = 0;
+	int blockNumber, offset, chunk, n;
+	unsigned char read[sb.block_size];
+	
+	for (n = firstBlock; n <= lastBlock; n++){
+		blockNumber = getFileBlock(fileID, n, 0);
+		if (blockNumber < 0){
+			break;
+		}
+		
+		offset = (n == firstBlock) ? (int)(start % sb.block_size) : 0;
+		chunk = sb.block_size - offset;
+		if (chunk > length - readLength){
+			chunk = length - readLength;
+		}
+		
+		// whole block is wanted, read it straight into the caller's buffer
+		if (chunk == sb.block_size){
+			fullBlocks[fullCount] = blockNumber;
+			fullBuffers[fullCount] = buf + readLength;
+			fullCount++;
+		}
+		else {
+			cache_read_blocks(blockNumber, 1, read);
+			memcpy(buf + readLength, read + offset, chunk);
+		}
+		readLength += chunk;
 	}
 	
+	if (fullCount > 0){
+		cache_read_block_list(fullCount, fullBlocks, fullBuffers);
+	}
+	free(fullBlocks);
+	free(fullBuffers);
+	
+	// a read starting where the last one stopped doubles the read-ahead window, any other read closes it
+	if (start == fd->lastReadEnd){
+		fd->readAhead = fd->readAhead == 0 ? 1 : fd->readAhead * 2;
+		if (fd->readAhead > readAheadMax){
+			fd->readAhead = readAheadMax;
+		}
+	}
+	else {
+		fd->readAhead = 0;
+		fd->readAheadEnd = 0;
+	}
 	
-	if (fdt[fileID].free == -1){
+	// start reading the following blocks in the background, skipping the ones already prefetched
+	if (fd->readAhead > 0){
+		int ahead[readAheadMax];
+		int aheadCount = 0;
+		n = lastBlock + 1 > fd->readAheadEnd ? lastBlock + 1 : fd->readAheadEnd;
+		for (; n <= lastBlock + fd->readAhead && n <= (int)((size - 1) / sb.block_size); n++){
+			blockNumber = getFileBlock(fileID, n, 0);
+			if (blockNumber >= 0){
+				ahead[aheadCount++] = blockNumber;
+			}
+		}
+		fd->readAheadEnd = n;
+		if (aheadCount > 0){
+			cache_prefetch(aheadCount, ahead);
+		}
+	}
+	
+	fdt[fileID].readptr += readLength;
+	fd->lastReadEnd = fdt[fileID].readptr;
+	return readLength;
+}
+
+/*
+ssfs_fread with the file locked for reading, any number of threads read a file together
+*/
+int ssfs_fread(int fileID, char *buf, int length){
+	int ret;
+	
+	if (lockFile(fileID, 0) < 0){
 		return -1;
 	}
+	ret = readFile(fileID, buf, length);
+	unlockFile(fileID);
+	return ret;
+}
+
+/*
+Read the data of a file without copying it : each view points at the bytes of one block
+in the block cache. Views stay valid until ssfs_release_views, which must come before the
+next mkssfs. Writes to the file while a view is held show through it.
+A file stored in its i-node has no block to pin, its one view is a copy with block number -1
+that ssfs_release_views frees, so writes don't show through it.
+fileID: file in the open descriptor table
+length : number of bytes to read, reads stop at the end of the file
+views : set to one view per block covered
+maxViews : number of views the caller has room for
+return : number of views, 0 at the end of the file, -1 if no block could be pinned
+*/
+int readFileViews(int fileID, int length, blockView_t *views, int maxViews){
 	
-	int block = fdt[fileID].inode / 13;
-	int slot = fdt[fileID].inode % 13;
-	int size = inodeBlocks[block].inodeSlot[slot].size;
+	// verify if file ID exist 
+	if(fileID < 0 || fileID >= fdtSize){
+		return -1;
+	}
 	
-	// location can't be bigger than size 
-	if(loc > size){
+	if (fdt[fileID].inode == -1 || length < 0 || maxViews < 0){
 		return -1;
 	}
 	
-	fdt[fileID].readptr = loc;
-	return 0;
+	fileDescriptor_t* fd = &fdt[fileID];
+	long long start = fd->readptr;
+	long long size;
+	int count = 0;
+	int readLength = 0;
+	int blockNumber, offset, chunk;
+	const char* data;
+	char* copy;
+	inode_t* inode;
+	
+	pthread_mutex_lock(&allocatorLock);
+	inode = getInode(fd->inode);
+	size = inode->size;
+	
+	// can't read past the end of the file 
+	if (start + length > size){
+		length = size - start;
+	}
+	
+	// the i-node cache may evict the bytes of a small file, the view keeps its own copy 
+	if (inode->tripleIndirect == inlineData){
+		if (length <= 0 || maxViews == 0){
+			pthread_mutex_unlock(&allocatorLock);
+			return 0;
+		}
+		copy = malloc(length);
+		if (copy == NULL){
+			pthread_mutex_unlock(&allocatorLock);
+			return -1;
+		}
+		memcpy(copy, (char*)inode->direct + start, length);
+		pthread_mutex_unlock(&allocatorLock);
+		views[0].data = copy;
+		views[0].length = length;
+		views[0].blockNumber = -1;
+		fd->readptr += length;
+		fd->lastReadEnd = fd->readptr;
+		return 1;
+	}
+	pthread_mutex_unlock(&allocatorLock);
+	
+	while (readLength < length && count < maxViews){
+		blockNumber = getFileBlock(fileID, (int)((start + readLength) / sb.block_size), 0);
+		// pinning fails when caching is off or every cached block is pinned 
+		data = blockNumber < 0 ? NULL : cache_pin_block(blockNumber);
+		if (data == NULL){
+			if (count == 0){
+				return -1;
+			}
+			break;
+		}
+		
+		offset = (int)((start + readLength) % sb.block_size);
+		chunk = sb.block_size - offset;
+		if (chunk > length - readLength){
+			chunk = length - readLength;
+		}
+		views[count].data = data + offset;
+		views[count].length = chunk;
+		views[count].blockNumber = blockNumber;
+		count++;
+		readLength += chunk;
+	}
 	
+	fd->readptr += readLength;
+	fd->lastReadEnd = fd->readptr;
+	return count;
 }
 
 /*
-seek the write pointer of the file descriptor table to the specific byte location
-fileID : file descriptor table index
-loc : byte location for write pointer to be placed.
+ssfs_fread_views with the file locked for reading
 */
-
-int ssfs_fwseek(int fileID, int loc){
-	
-	// check if fileID is valid
+int ssfs_fread_views(int fileID, int length, blockView_t *views, int maxViews){
+	int ret;
 	
-	if (loc < 0){
+	if (lockFile(fileID, 0) < 0){
 		return -1;
 	}
+	ret = readFileViews(fileID, length, views, maxViews);
+	unlockFile(fileID);
+	return ret;
+}
+
+/*
+Unpin the blocks behind views returned by ssfs_fread_views
+*/
+void ssfs_release_views(blockView_t *views, int count){
+	int i;
+	for (i = 0; i < count; i++){
+		if (views[i].blockNumber == -1){
+			free((char*)views[i].data);
+		}
+		else {
+			cache_unpin_block(views[i].blockNumber);
+		}
+	}
+}
+
+/*
+remove file from directory entry, release the i-node entry and releasr the data blocks by the file.
+The directories are locked, the allocator lock is let go while the file's reads and writes finish.
+return : 0 or -1 if there is no such file
+*/ 
+int removeFile(char *file){
+	int i,k;
+	int inodeIndexFound;
+	char fileName[maxNameLength + 1];
+	directoryEntry_t entry;
+	int dirInode = resolvePath(file, fileName);
 	
-	if(fileID < 0 || fileID >= numberOfInodes){
+	//Delete from its directory and remove inode and free data blocks of the inode
+	i = dirInode == -1 ? -1 : lookupEntry(dirInode, fileName, &entry);
+	if (i == -1 || entry.type != entryFile){
 		return -1;
 	}
 	
+	// found the entry
+	inodeIndexFound = entry.inodeIndex;
 	
-	if (fdt[fileID].free == -1){
-		return -1;
+	// reads and writes in flight on the file finish first, its descriptors close with it 
+	pthread_mutex_unlock(&allocatorLock);
+	for(k = openDescriptors[openBucket(inodeIndexFound)]; k != -1; k = nextDescriptor[k]){
+		if (fdt[k].inode == inodeIndexFound){
+			pthread_mutex_lock(&descriptorLocks[k]);
+		}
 	}
+	pthread_rwlock_wrlock(inodeLock(inodeIndexFound));
+	pthread_mutex_lock(&allocatorLock);
 	
-	int block = fdt[fileID].inode / 13;
-	int slot = fdt[fileID].inode % 13;
-	int size = inodeBlocks[block].inodeSlot[slot].size;
-	if(loc > size){
-		return -1;
+	//delete it from the directory 
+	removeEntry(dirInode, i, &entry);
+	
+	// remove inode, its pointer blocks and its data blocks 
+	releaseInode(inodeIndexFound);
+	endTransaction();
+				
+	//close file if open 
+	while ((k = openDescriptorOf(inodeIndexFound)) != -1){
+		releaseFileDescriptor(k);
+		pthread_mutex_unlock(&descriptorLocks[k]);
 	}
+	pthread_rwlock_unlock(inodeLock(inodeIndexFound));
 	
-	fdt[fileID].rwptr = loc;
 	return 0;
 }
+
 /*
-writing inside the data blocks of a file
-if file is new, allocate a data block
-fileID: file in the open descriptor table
-buf : buffer to write from 
-length : number of bytes to write 
-return : length written
+ssfs_remove with the directories locked
 */
+int ssfs_remove(char *file){
+	int ret;
+	
+	lockDirectories();
+	ret = removeFile(file);
+	unlockDirectories();
+	return ret;
+}
 
-int ssfs_fwrite(int fileID, char *buf, int length){
+/*
+make a file or a directory, its parent must exist
+path : path of the new entry
+type : entryFile or entryDirectory
+return : 0 or -1 if it exists or can't be created
+*/
+int makeEntry(char *path, int type){
+	char name[maxNameLength + 1];
+	directoryEntry_t entry;
+	int dirInode = resolvePath(path, name);
+	
+	if (dirInode == -1 || lookupEntry(dirInode, name, &entry) != -1){
+		return -1;
+	}
+	if (createEntry(dirInode, name, type) == -1){
+		endTransaction();
+		return -1;
+	}
+	endTransaction();
+	return 0;
+}
+
+/*
+ssfs_mkdir with the directories locked
+*/
+int ssfs_mkdir(char *path){
+	int ret;
 	
-	if(fileID < 0 || fileID >= numberOfInodes){
+	lockDirectories();
+	ret = makeEntry(path, entryDirectory);
+	unlockDirectories();
+	return ret;
+}
+
+/*
+remove an empty directory
+path : path of the directory, the root directory can't be removed
+return : 0 or -1
+*/
+int removeDirectory(char *path){
+	char name[maxNameLength + 1];
+	directoryEntry_t entry;
+	directoryEntry_t child;
+	int slot;
+	int dirInode = resolvePath(path, name);
+	
+	if (dirInode == -1){
+		return -1;
+	}
+	slot = lookupEntry(dirInode, name, &entry);
+	if (slot == -1 || entry.type != entryDirectory){
 		return -1;
 	}
 	
-	// verify if file ID exist 
-	if (fdt[fileID].inode == -1){
+	// only empty directories are removed 
+	if (scanDirectory(entry.inodeIndex, 0, NULL, 0, &child) != -1){
 		return -1;
 	}
 	
-	int inodeIndex = fdt[fileID].inode;
-	int i = inodeIndex / 13;
-	int slotIndex = inodeIndex % 13;
-	int size = inodeBlocks[i].inodeSlot[slotIndex].size;
-	int writeInDataBlock;
-	
-	// char to start writting from in a data block 
-	int k = fdt[fileID].rwptr % 1024;
-	int currentBlock = 0;
-	int p;
+	removeEntry(dirInode, slot, &entry);
+	releaseInode(entry.inodeIndex);
+	endTransaction();
+	return 0;
+}
 
-	block_t write;	
-		
-	//check which block in the inode where the pointer is currently at 
-	currentBlock = fdt[fileID].rwptr / blockSize;
-
-	// if the block is > 14 than need to search through the indirect of the i-nodes	
-	int m;
-	int nextInodeOfFile = i;
-	int nextSlot = slotIndex;
-	int nextDirect = i;
-	
-	if (currentBlock >= 14){
-		 nextInodeOfFile = currentBlock / 14; 
-		 
-		 // get to the last inode of the file 
-		 for(m = 0; m < nextInodeOfFile; m++){
-			nextInodeOfFile = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect / 13;
-			nextSlot = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect % 13;
-		 }
-		 
-		 // find the last direct block written in 
-		 for(m = 0 ; m < 14; m++){
-			 if (inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[m] == -1){
-				 nextDirect = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[m - 1];
-			 }
-		 }
-	}
-	
-	int totalWritingSize = fdt[fileID].rwptr + length;		
-	int remaining = 0;
-	int numberOfBlocksToAllocate = 0;
-	int firstBlockDataLength = 0;
-	int lastBlockDataLength = 0;
-	
-	// check if file is going to overflow to another data block
-	if (totalWritingSize > (currentBlock + 1) * blockSize){
-		// data to be written to fill up the current block 
-		firstBlockDataLength = blockSize - k;
-		// rest of data to be written in the other blocks 
-		remaining = length - firstBlockDataLength;
-		// need to allocate more blocks to satisfy write size
-		if (remaining > 0){
-			// need atleast 1 block to allocate 
-			numberOfBlocksToAllocate = (remaining / blockSize) + 1;	
-			lastBlockDataLength = remaining % blockSize;
-		}
-	}
-	
-	// If new file then allocate atleast 1 block 
-	if(size == 0){
-		allocateDataBlock(inodeIndex);
-		inodeBlocks[i].inodeSlot[slotIndex].size = 0;
-		fdt[fileID].rwptr = 0;
-	}
-	
-	// don't need to allocate new data block if enough space
-	if (numberOfBlocksToAllocate == 0){
-		writeInDataBlock = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[nextDirect];
-		read_blocks(writeInDataBlock,1, &write);
-		memcpy(write.bytes + k,buf,length);
-		write_blocks(writeInDataBlock, 1, &write);
-		inodeBlocks[i].inodeSlot[slotIndex].size = totalWritingSize;
-		fdt[fileID].rwptr += length;
+/*
+ssfs_rmdir with the directories locked
+*/
+int ssfs_rmdir(char *path){
+	int ret;
 	
-		return length;
+	lockDirectories();
+	ret = removeDirectory(path);
+	unlockDirectories();
+	return ret;
+}
+
+/*
+list a directory one entry at a time
+path : path of the directory, "/" for the root directory
+cursor : set to 0 before the first call, moved past the entry returned
+name : set to the entry name, holds 12 characters, directory names end with '/'
+return : 1 if an entry was returned, 0 at the end of the directory, -1 if path is not a directory
+*/
+int readDirectory(char *path, int *cursor, char *name){
+	directoryEntry_t entry;
+	int slot;
+	int dirInode = resolveDirectory(path);
+	
+	if (dirInode == -1 || *cursor < 0){
+		return -1;
 	}
 	
-	else {
-		
-		// need to allocate more blocks if the length of the write is going to be a lot 	
-		for(p = 0; p < numberOfBlocksToAllocate ; p++){
-			allocateDataBlock(inodeIndex);
+	slot = scanDirectory(dirInode, *cursor, NULL, 0, &entry);
+	if (slot == -1){
+		return 0;
+	}
+	
+	memset(name, 0, maxNameLength + 2);
+	strncpy(name, entry.name, maxNameLength);
+	if (entry.type == entryDirectory){
+		strcat(name, "/");
+	}
+	*cursor = slot + 1;
+	return 1;
+}
+
+/*
+ssfs_readdir with the directories locked
+*/
+int ssfs_readdir(char *path, int *cursor, char *name){
+	int ret;
+	
+	lockDirectories();
+	ret = readDirectory(path, cursor, name);
+	unlockDirectories();
+	return ret;
+}
+
+/*
+Apply a list of creates, removes and mkdirs under one hold of the locks. Their metadata changes share
+one commit unless they outgrow the journal, every block they touch is written once per commit.
+The batch is durable when it returns. A failed operation doesn't stop the ones after it.
+ops : operations in the order to apply them, the result of each is set to 0 or -1
+count : number of operations
+return : number of operations done or -1 if the commit failed
+*/
+int ssfs_batch(batchOp_t *ops, int count){
+	int i;
+	int done = 0;
+	int ret;
+	
+	lockDirectories();
+	inBatch = 1;
+	for (i = 0; i < count; i++){
+		if (ops[i].type == batchRemove){
+			ops[i].result = removeFile(ops[i].path);
 		}
-				
-		writeInDataBlock = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[nextDirect];
-		read_blocks(writeInDataBlock,1, &write);
-		
-		// start by writing to the current block;
-		int dataLength = firstBlockDataLength; 
-		k = size % 1024;
-		memcpy(write.bytes + k, buf, dataLength);
-		write_blocks(writeInDataBlock, 1, &write);
-		// might have to write the inode block back
-		int n = 0;
-		
-		// need to go to next inode  if next data block to write is after direct[14] 
-		if ((nextDirect + n) > 14){
-			nextInodeOfFile =  inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect / 13;
-			nextSlot = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect % 13;
-			nextDirect = 0;
+		else if (ops[i].type == batchCreate || ops[i].type == batchMkdir){
+			ops[i].result = makeEntry(ops[i].path, ops[i].type == batchCreate ? entryFile : entryDirectory);
 		}
-		
-		// now need to write to the completely filled 
-		if (numberOfBlocksToAllocate > 1){
-			
-			for (n = 1; n < numberOfBlocksToAllocate ; n++){
-				nextDirect += 1;
-				// need to go to next inode if next data block to write after direct[14]
-				if (nextDirect > 14){
-					nextInodeOfFile =  inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect / 13;
-					nextSlot = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect % 13;
-					nextDirect = 0;
-				}
-				
-				writeInDataBlock = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[nextDirect];
-				read_blocks(writeInDataBlock, 1, &write);
-				memcpy(write.bytes, buf +((currentBlock - 1 + n) * blockSize) + dataLength, blockSize);
-				write_blocks(writeInDataBlock, 1, &write);
-				
-			}
-			
+		else {
+			ops[i].result = -1;
 		}
-		
-		// write to the last block  and update pointer 
-		int lastDataLength = lastBlockDataLength;	
-		writeInDataBlock = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[nextDirect + 1];
-		read_blocks(writeInDataBlock,1, &write);
-		memcpy(&(write.bytes), buf + ((currentBlock - 1 + n) * blockSize) + dataLength, lastDataLength);
-		write_blocks(writeInDataBlock, 1, &write);
-		inodeBlocks[i].inodeSlot[slotIndex].size = totalWritingSize;
-		fdt[fileID].rwptr += length;
-		// might have to write the inode block back
-		return length;
-		}		
-	return -1;
+		if (ops[i].result == 0){
+			done++;
+		}
+	}
+	inBatch = 0;
+	ret = commitJournal();
+	unlockDirectories();
+	return ret < 0 ? -1 : done;
 }
 
 /*
-Read inside the data blocks of a file
-fileID: file in the open descriptor table
-buf : buffer to write from 
-length : number of bytes to write 
-return : length written
+Take a snapshot of the file system. Nothing is copied : the snapshot holds every data block in use and
+shares the i-node file and the root directory, the live file system copies a held data block before changing
+it and an i-node file or root directory block to the image before its first change. A snapshot costs the bit
+map of the blocks it holds and the blocks changed after it.
+return : id of the snapshot or -1 if every slot is used or the disk is full
 */
-
-int ssfs_fread(int fileID, char *buf, int length){
+int takeSnapshot(){
+	int id, i, start, length;
+	int imageBlocks = snapshotImageBlocks(&sb);
+	int heldStart = sb.inodeTableBlocks + sb.rootDirectoryBlocks;
+	int mapBlocks = imageBlocks - heldStart - sb.fbmBlocks;
+	size_t bytes = (size_t)sb.fbmBlocks * sb.block_size;
+	size_t b;
+	unsigned char* held;
+	unsigned char* copies;
+	
+	for (id = 0; id < numberOfShadows && sb.shadow[id].size != -1; id++);
+	if (id == numberOfShadows){
+		return -1;
+	}
+	// the changes made before the snapshot go in their own transactions 
+	if (commitJournal() < 0){
+		return -1;
+	}
 	
-	// verify if file ID exist 
-	if(fileID < 0 || fileID >= numberOfInodes){
+	// the image is one run of blocks, the blocks freed since the last checkpoint may complete it 
+	start = FBMGetFreeRun(imageBlocks, &length);
+	if (start != -1 && length < imageBlocks && releasedBlockCount > 0){
+		for (i = start; i < start + length; i++){
+			setFBMbit(i);
+		}
+		reclaimReleasedBlocks();
+		start = FBMGetFreeRun(imageBlocks, &length);
+	}
+	if (start == -1){
+		return -1;
+	}
+	held = malloc(bytes);
+	copies = calloc(mapBlocks, sb.block_size);
+	if (length < imageBlocks || held == NULL || copies == NULL){
+		for (i = start; i < start + length; i++){
+			setFBMbit(i);
+		}
+		free(held);
+		free(copies);
 		return -1;
 	}
 	
-	if (fdt[fileID].inode == -1){
+	// every data block in use and the image itself, which the live file system sees as free again 
+	for (b = 0; b < bytes; b++){
+		held[b] = ~fbm[b];
+	}
+	clearMetadataBits(held);
+	for (i = start; i < start + imageBlocks; i++){
+		setFBMbit(i);
+	}
+	
+	cache_write_blocks(start + heldStart, sb.fbmBlocks, held);
+	cache_write_blocks(start + heldStart + sb.fbmBlocks, mapBlocks, copies);
+	snapshotBlocks[id] = held;
+	buildSharedBlocks();
+	
+	// the run was taken then given back, the bit map blocks are dirty but unchanged. Committing them apart
+	// writes the image and leaves the super block alone in the last transaction, which always fits the journal 
+	if (commitJournal() < 0){
+		return -1;
+	}
+	sb.shadow[id].size = (long long)imageBlocks * sb.block_size;
+	sb.shadow[id].direct[0] = start;
+	sb.lastShadow = id;
+	// the i-node file and root directory blocks change after the image is placed 
+	snapshotCopies[id] = copies;
+	markMetadataDirty(0);
+	if (commitJournal() < 0){
 		return -1;
 	}
+	return id;
+}
+
+/*
+ssfs_snapshot once the reads and writes in flight are done
+*/
+int ssfs_snapshot(){
+	int ret;
 	
-	int inodeIndex = fdt[fileID].inode;
-	int i = inodeIndex / 13;
-	int slotIndex = inodeIndex % 13;
-	int size = inodeBlocks[i].inodeSlot[slotIndex].size;
-	
-	int readInDataBlock;
-	int directNumber;	
-	
-	// char to start writting from in a data block 
-	int k = fdt[fileID].readptr % 1024;
-	int currentBlock = 0;
-
-	block_t read;	
-	
-	currentBlock = fdt[fileID].readptr / blockSize;
-	
-	// if the block is > 14 than need to search through the indirect of the inodes	
-	
-	int m;
-	int nextInodeOfFile = i;
-	int nextSlot = slotIndex;
-	int nextDirect = i;
-	
-	if (currentBlock >= 14){
-		 nextInodeOfFile = currentBlock / 14; 
-		 
-		 // get to the last inode of the file 
-		 for(m = 0; m < nextInodeOfFile; m++){
-			nextInodeOfFile = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect / 13;
-			nextSlot = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect % 13;
-		 }
-		 
-		 // find the last direct block written in 
-		 for(m = 0 ; m < 14; m++){
-			 if (inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[m] == -1){
-				 nextDirect = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[m - 1];
-			 }
-		 }
-	}
-	
-	int totalReadSize = fdt[fileID].readptr + length;		
-	int remaining = 0;
-	int numberOfBlocksToRead = 0;
-	int firstBlockDataLength = 0;
-	int lastBlockDataLength = 0;
-	
-	// check if file is going to overflow 
-	if (totalReadSize > (currentBlock + 1) * blockSize){
-		// data to be read in the current block 
-		firstBlockDataLength = blockSize - k ;
-		// rest of data to be written in the other blocks 
-		remaining = length - firstBlockDataLength;
-		// need to read blocks if remaining is bigger than 0 
-		if (remaining > 0){
-			// need atleast 1 extra block to read
-			numberOfBlocksToRead = (remaining / blockSize) + 1;	
-			lastBlockDataLength = remaining % blockSize;
+	lockEverything();
+	ret = takeSnapshot();
+	unlockEverything();
+	return ret;
+}
+
+/*
+List the snapshots on the disk
+ids : set to the id of every snapshot, holds numberOfShadows ids
+return : number of snapshots
+*/
+int listSnapshots(int *ids){
+	int k;
+	int count = 0;
+	
+	for (k = 0; k < numberOfShadows; k++){
+		if (sb.shadow[k].size != -1){
+			ids[count++] = k;
 		}
 	}
+	return count;
+}
+
+/*
+ssfs_list_snapshots with the directories locked
+*/
+int ssfs_list_snapshots(int *ids){
+	int ret;
 	
-	else {
+	lockDirectories();
+	ret = listSnapshots(ids);
+	unlockDirectories();
+	return ret;
+}
+
+/*
+Bring the file system back to a snapshot, the snapshot is kept. Open files are closed.
+id : snapshot to roll back to
+return : 0 or -1 if there is no such snapshot
+*/
+int rollbackSnapshot(int id){
+	int i;
 	
-		// don't need to allocate new data block if enough space in the block  
-		if (numberOfBlocksToRead == 0){
-			
-			directNumber = currentBlock;  
-			readInDataBlock = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[nextDirect];
-			
-			read_blocks(readInDataBlock,1, &read);
-			
-			memcpy(buf, read.bytes + k, length);
-			buf[length] = '\0';
-			fdt[fileID].readptr += length;
-			
-			return length;
+	if (id < 0 || id >= numberOfShadows || sb.shadow[id].size == -1 || snapshotBlocks[id] == NULL
+		|| snapshotCopies[id] == NULL){
+		return -1;
+	}
+	
+	for (i = 0; i < fdtSize; i++){
+		if (fdt[i].inode != -1){
+			releaseFileDescriptor(i);
 		}
-		
-		else {
-			readInDataBlock = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[nextDirect];
-			read_blocks(readInDataBlock,1, &read);
-			
-			// start by writing to the current block;
-			int dataLength = firstBlockDataLength;
-			k = size % 1024;
-			
-			char block[length];
-			
-			memcpy(block, read.bytes, dataLength);
-			
-			int n = 1;
-			
-			if ((nextDirect + n) > 14){
-				nextInodeOfFile =  inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect / 13;
-				nextSlot = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect % 13;
-				nextDirect = 0;
-			}
-					
-			// now need to write to the completely filled 
-			if (numberOfBlocksToRead > 1){
-				
-				for (n = 1; n < numberOfBlocksToRead ; n++){
-					
-				nextDirect += 1;
-				
-					// need to go to next inode if next data block to write after direct[14]
-				if (nextDirect > 14){
-					nextInodeOfFile =  inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect / 13;
-					nextSlot = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].indirect % 13;
-					nextDirect = 0;
-				}
-				
-				readInDataBlock = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[nextDirect];
-				read_blocks(readInDataBlock, 1, &read);
-				
-				memcpy(block + ((currentBlock - 1 + n) * blockSize) + dataLength , read.bytes, blockSize);
-				                         
-				}
-				
-			}
-			
-			// read the last block  and update pointer 
-			int lastDataLength = lastBlockDataLength;
-				
-			readInDataBlock = inodeBlocks[nextInodeOfFile].inodeSlot[nextSlot].direct[nextDirect + 1];
-			read_blocks(readInDataBlock,1, &read);
-			
-			memcpy(block + ((currentBlock - 1 + n) * blockSize) + dataLength,read.bytes, lastDataLength);
-			
-			strcpy(buf,block);
-			fdt[fileID].readptr += length;
-			return length;
-			}		
 	}
 	
-	return -1; 
+	// the changes made before the rollback go in their own transactions, the record in one of its own 
+	if (commitJournal() < 0){
+		return -1;
+	}
+	sb.rollbackShadow = id;
+	markMetadataDirty(0);
+	if (commitJournal() < 0){
+		return -1;
+	}
+	
+	restoreSnapshot(id);
+	return finishRollback();
 }
 
 /*
-remove file from directory entry, release the i-node entry and releasr the data blocks by the file
-*/ 
-int ssfs_remove(char *file){
-	int i,k,p;
-	int inodeIndexFound;
-	int inodeBlock; 
-	int slot;
+ssfs_rollback once the reads and writes in flight are done
+*/
+int ssfs_rollback(int id){
+	int ret;
 	
-	if (strlen(file) > 10){
+	lockEverything();
+	ret = rollbackSnapshot(id);
+	unlockEverything();
+	return ret;
+}
+
+/*
+Drop a snapshot, the blocks only it held can be allocated again
+id : snapshot to drop
+return : 0 or -1 if there is no such snapshot
+*/
+int deleteSnapshot(int id){
+	int b;
+	int mapStart;
+	
+	if (id < 0 || id >= numberOfShadows || sb.shadow[id].size == -1){
 		return -1;
 	}
 	
-	//Delete from root directory and remove inode and free data blocks of the inode
-	for(k = 0; k < 4; k++){
-		for(i = 0; i < 64; i++){
-			
-			//limited file to 200 
-			if (k * 64 + i > 200){
-				return -1;
-			}
-			
-			if (strcmp(rootDirectory[k].entries[i].name, file) == 0){
-				// found the entry
-				inodeIndexFound = rootDirectory[k].entries[i].inodeIndex;
-				
-				//delete it from the directory 
-				rootDirectory[k].entries[i].inodeIndex = -1;
-				strcpy(rootDirectory[k].entries[i].name, "root/");
-				
-				inodeBlock = inodeIndexFound / 13;
-				slot = inodeIndexFound % 13;
-				
-				// remove inode and inode files 
-				
-				inode_t removeInode;
-				removeInode.size = -1;
-				for(p = 0 ; p < 14; p++){
-					if (inodeBlocks[inodeBlock].inodeSlot[slot].direct[p] != -1){
-						setFBMbit(inodeBlocks[inodeBlock].inodeSlot[slot].direct[p]);
-						}
-						removeInode.direct[p] = -1;
-				}
-				
-			// set the inode slot to be free 
-			inodeBlocks[inodeBlock].inodeSlot[slot] = removeInode;
-							
-			//close file if open 
-			
-			for(i = 0; i < numberOfInodes; i++){
-				if (fdt[i].inode == inodeIndexFound){
-					fdt[i].inode = -1;
-					fdt[i].free = -1;
-					fdt[i].rwptr = 0;
-					fdt[i].readptr = 0;
-				}
-			}
-			
-			return 0;
-			}
+	// the bit map of the copies goes through the journal, a committed transaction replayed after a crash
+	// may still write it so its blocks wait for the checkpoint 
+	mapStart = sb.shadow[id].direct[0] + sb.inodeTableBlocks + sb.rootDirectoryBlocks + sb.fbmBlocks;
+	for (b = mapStart; b < sb.shadow[id].direct[0] + snapshotImageBlocks(&sb); b++){
+		dropJournaledBlock(b);
+		if (!((releasedBlocks[b / 8] >> (b % 8)) & 1)){
+			releasedBlocks[b / 8] |= 1 << (b % 8);
+			releasedBlockCount++;
 		}
 	}
-	return -1;
+	free(snapshotBlocks[id]);
+	free(snapshotCopies[id]);
+	snapshotBlocks[id] = NULL;
+	snapshotCopies[id] = NULL;
+	buildSharedBlocks();
+	
+	sb.shadow[id].size = -1;
+	sb.shadow[id].direct[0] = -1;
+	if (sb.lastShadow == id){
+		sb.lastShadow = -1;
+	}
+	markMetadataDirty(0);
+	return commitJournal();
+}
+
+/*
+ssfs_delete_snapshot once the reads and writes in flight are done
+*/
+int ssfs_delete_snapshot(int id){
+	int ret;
+	
+	lockEverything();
+	ret = deleteSnapshot(id);
+	unlockEverything();
+	return ret;
 }
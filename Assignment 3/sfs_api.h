@@ -1,42 +1,85 @@
 #include "disk_emu.h"
 
 // size of components
-#define blockSize 1024
 #define sizeOfPointer 4
-// might modified numberOf blocks
-#define numberOfBlocks 1024
-#define numberOfInodes 200
 #define sizeOfInode 64
 #define sizeOfSuperBlockField 4
 
-#define numberOfEntries 64
+// geometry used by mkssfs(1), mkssfs_geometry picks any other one
+#define defaultBlockSize 1024
+#define defaultNumberOfBlocks 1024
+#define defaultNumberOfInodes 200
+// block size must be a power of 2 in this range, the super block fits in the smallest one
+#define minBlockSize 512
+#define maxBlockSize 65536
+
+#define numberOfDirect 11
+// depth of the deepest pointer block tree hanging off an i-node
+#define maxIndirectLevel 3
+// snapshot slots in the super block
+#define numberOfShadows 4
 
 #define myFileName "WDDNguyen"
 
+// disk backend of mkssfs unless ssfs_disk_backend picks the other one, metadata updates go straight to the mapping
+#define defaultDiskBackend DISK_BACKEND_MMAP
+// blocks held by the write-back cache, 0 writes straight through to the disk
+#define cacheCapacity 128
+// metadata journal : blocks in the journal region, operations sharing one commit and
+// data region blocks holding pointers or directory entries waiting for the next commit
+#define defaultJournalBlocks 64
+#define groupCommitOps 32
+#define maxJournaledBlocks 32
+#define journalMagic 0x4A524E4C
+#define journalSuperMagic 0x4A535550
+
+// blocks of the i-node file held in memory, they are read when first used
+#define inodeCacheBlocks 64
+
+// files open at once whatever the number of i-nodes, and reader/writer locks the i-nodes are spread over.
+// Both are powers of 2
+#define maxOpenFiles 1024
+#define inodeLockStripes 256
+
+// largest read-ahead window of a sequential reader, in blocks
+#define readAheadMax 32
+// finished blocks a sequential writer gathers before writing them back in the background
+#define writeBehindBlocks 16
+
 // non standard inode
 // size field  total number of bytes
-// no need to know about indirect
 // these block contains data
+// indirect blocks hold block_size / 4 block numbers, of data blocks or of the next level of pointer blocks
 
-//File has lots of inodes
 // for j node   size = size of the file
 // set size = -1 to be blank
 
 
+// a file holding at most inlineDataSize bytes keeps them in its i-node in place of direct, indirect
+// and doubleIndirect, tripleIndirect is then inlineData. Its data moves to a data block once it grows past that
+#define inlineData -2
+#define inlineDataSize ((numberOfDirect + 2) * sizeOfPointer)
+
+// size is 64 bit, a 64 byte i-node keeps 11 direct pointers next to it
 typedef struct {
-	int size;
-	int direct[14];
+	long long size;
+	int direct[numberOfDirect];
 	int indirect;
+	int doubleIndirect;
+	int tripleIndirect;
 } inode_t;
 
 
-typedef struct {
-	inode_t inodeSlot[16];
-} inodeBlock_t;
+// last byte of the magic number, it changes with every change of the disk layout
+#define diskFormatVersion 0x0B
 
 // root is a jnode
-// have to add shadow jnode later
-// need to fill to get to 1024 or  copy memory to block_t then pass that to the disk * calloc
+// shadow[i] is the j-node of snapshot i, size -1 when the slot is free. Its image is one run of blocks
+// from direct[0] on : the i-node file, the root directory, the bit map of the blocks the snapshot holds
+// then the bit map of the i-node file and root directory blocks copied to the image. The others are shared
+// with the live file system, which copies one to the image before its first change.
+// lastShadow is the latest snapshot taken, -1 if none
+// rollbackShadow is the snapshot a rollback left half way is bringing back, -1 if none. Mounting completes it
 
 typedef struct {
 
@@ -46,40 +89,119 @@ int block_size;
 int fs_size;
 int Inodes;
 inode_t root;
-inode_t shadow[4];
+inode_t shadow[numberOfShadows];
 int lastShadow;
-int rootDirectoryBlockNumber[4];
-//filling up the super block with empty value
-char fill[668];
+int rollbackShadow;
+// disk layout : super block, free bit map, i-node bit map, root directory, i-node file, journal then data blocks
+int fbmStart;
+int fbmBlocks;
+int ibmStart;
+int ibmBlocks;
+int rootDirectoryStart;
+int rootDirectoryBlocks;
+int inodeTableStart;
+int inodeTableBlocks;
+int journalStart;
+int journalBlocks;
+int dataStart;
 } superblock_t;
 
-
-// can use uint8_t
-typedef struct{
-	unsigned char bytes[blockSize];
-}block_t;
-
+// first block of a journal transaction, the images of the blocks listed follow it.
+// checksum covers sequence, count, the block list and the images
+typedef struct {
+unsigned int magic;
+int sequence;
+int count;
+unsigned int checksum;
+int blocks[];
+} journalHeader_t;
+
+// first block of the journal, written in place at every checkpoint. The transactions
+// that follow it are not home yet, replay starts with the one numbered sequence
+typedef struct {
+unsigned int magic;
+int sequence;
+} journalSuper_t;
+
+// blockMap caches the data block of each file block looked up through this descriptor, -1 if not looked up yet
+// readAhead is the read-ahead window in blocks, 0 while reads are not sequential,
+// blocks before readAheadEnd were already prefetched. Blocks of a sequential writer from
+// writeBehindStart on are not handed to the cache for background write back yet.
 typedef struct {
     int free;
     int inode;
-    int rwptr;
-	int readptr;
+    long long rwptr;
+	long long readptr;
+	int* blockMap;
+	int mapLength;
+	long long lastReadEnd;
+	int readAhead;
+	int readAheadEnd;
+	long long lastWriteEnd;
+	int writeBehindStart;
 } fileDescriptor_t;
 
+// entry types, a directory i-node holds directory entries in its data blocks
+#define entryFile 0
+#define entryDirectory 1
+// longest path component 
+#define maxNameLength 10
+// path lookups remembered by the dentry cache
+#define dentryCacheSize 256
+
 typedef struct {
     char name[10];
+    char type;
     int inodeIndex;
 } directoryEntry_t;
 
-typedef struct{
-	directoryEntry_t entries[64];
-} rootDirectory_t;
+// dentry cache slot : name looked up in the directory i-node parent, parent is -1 when the slot is empty
+typedef struct {
+    int parent;
+    int slot;
+    directoryEntry_t entry;
+} dentry_t;
+
+// read-only view of file data in place in the block cache, pinned until ssfs_release_views.
+// blockNumber is -1 for the copy of a file stored in its i-node
+typedef struct {
+	const char* data;
+	int length;
+	int blockNumber;
+} blockView_t;
+
+// operations of ssfs_batch : create a file, remove a file, make a directory
+#define batchCreate 0
+#define batchRemove 1
+#define batchMkdir 2
+
+// one operation of ssfs_batch on a path, result is set to 0 or -1
+typedef struct {
+	int type;
+	char* path;
+	int result;
+} batchOp_t;
 
+// every call may come from any thread, except mkssfs, mkssfs_geometry and ssfs_disk_backend which run alone
 void mkssfs(int fresh);
+int mkssfs_geometry(int blockSize, int numberOfBlocks, int numberOfInodes);
+int ssfs_disk_backend(int backend);
 int ssfs_fopen(char *name);
 int ssfs_fclose(int fileID);
-int ssfs_frseek(int fileID, int loc);
-int ssfs_fwseek(int fileID, int loc);
+int ssfs_frseek(int fileID, long long loc);
+int ssfs_fwseek(int fileID, long long loc);
 int ssfs_fwrite(int fileID, char *buf, int length);
 int ssfs_fread(int fileID, char *buf, int length);
+int ssfs_fread_views(int fileID, int length, blockView_t *views, int maxViews);
+long long ssfs_fsize(int fileID);
+void ssfs_release_views(blockView_t *views, int count);
 int ssfs_remove(char *file);
+int ssfs_mkdir(char *path);
+int ssfs_rmdir(char *path);
+int ssfs_readdir(char *path, int *cursor, char *name);
+int ssfs_batch(batchOp_t *ops, int count);
+int ssfs_sync();
+int ssfs_snapshot();
+int ssfs_list_snapshots(int *ids);
+int ssfs_rollback(int id);
+int ssfs_delete_snapshot(int id);
@@ -0,0 +1,117 @@
+#include "tests.h"
+/*
+Blocks freed and given to another file must keep the new file's data after a remount :
+the journal must not bring back metadata of the removed file over them.
+*/
+int test_remount_reused_blocks(int *err_no){
+  int first_length = 20 * 1024;
+  int second_length = 30 * 1024;
+  char *first = malloc(first_length);
+  char *second = malloc(second_length);
+  char *read_buf = calloc(second_length, sizeof(char));
+  int file_id;
+
+  printf("Checking Blocks Reused After Remove ... \n");
+  memset(first, 'A', first_length);
+  memset(second, 'B', second_length);
+  mkssfs(1);
+  file_id = ssfs_fopen("a");
+  ssfs_fwrite(file_id, first, first_length);
+  ssfs_fclose(file_id);
+  ssfs_remove("a");
+  file_id = ssfs_fopen("b");
+  ssfs_fwrite(file_id, second, second_length);
+  ssfs_fclose(file_id);
+
+  mkssfs(0);
+  file_id = ssfs_fopen("b");
+  if(ssfs_fread(file_id, read_buf, second_length) != second_length){
+    fprintf(stderr, "Error. Invalid number read after remount\n");
+    *err_no += 1;
+  }else if(memcmp(read_buf, second, second_length) != 0){
+    fprintf(stderr, "Error. Reused blocks changed by the remount\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+  ssfs_remove("b");
+
+  free(first);
+  free(second);
+  free(read_buf);
+  return 0;
+}
+
+/*
+Difficult testing which writes, seeks and reads files spanning many data blocks.
+For all tests, -1 is considered error and 0 is considered success. 
+*/
+int difficult_test(){
+  printf("\n-------------------------------\nInitializing Difficult test.\n--------------------------------\n\n");
+  char **write_buf;
+  int *file_id = calloc(ABS_CAP_FD, sizeof(int));
+  char **file_names = calloc(ABS_CAP_FD, sizeof(char *));
+  int *write_ptr = calloc(ABS_CAP_FD, sizeof(int));
+  int *file_size = calloc(ABS_CAP_FD, sizeof(int));
+  int num_file = 5;
+  int iterations = 20;
+  int err_no = 0;
+
+  write_buf = calloc(MAX_FD, sizeof(char *));
+  for(int i = 0; i < MAX_FD; i++)
+    write_buf[i] = calloc(MAX_BYTES, sizeof(char));
+
+  //Init fresh file system
+  mkssfs(1);
+  test_open_new_files(file_names, file_id, num_file, &err_no);
+  //Large writes at random offsets, each one read back right away
+  for(int i = 0; i < iterations; i++){
+    if(test_difficult_write_files(file_id, file_size, write_ptr, write_buf, num_file, &err_no) < 0)
+      break;
+    test_random_read_files(file_id, file_size, write_ptr, write_buf, num_file, &err_no);
+  }
+  test_read_all_files(file_id, file_size, write_buf, num_file, &err_no);
+  test_read_write_out_of_bound(file_id, file_size, file_names, num_file, &err_no);
+
+  //Files spanning many blocks have to survive a close and a reopen
+  test_close_files(file_names, file_id, num_file, &err_no);
+  test_open_old_files(file_names, file_id, num_file, &err_no);
+  test_read_all_files(file_id, file_size, write_buf, num_file, &err_no);
+
+  //Freed blocks are reused by new files
+  test_remove_files(file_id, file_size, write_ptr, file_names, write_buf, num_file, &err_no);
+  free_name_element(file_names, num_file);
+  test_open_new_files(file_names, file_id, num_file, &err_no);
+  for(int i = 0; i < iterations; i++){
+    if(test_difficult_write_files(file_id, file_size, write_ptr, write_buf, num_file, &err_no) < 0)
+      break;
+  }
+  test_read_all_files(file_id, file_size, write_buf, num_file, &err_no);
+
+  //Blocks of a removed file reused by another one survive a remount
+  test_remount_reused_blocks(&err_no);
+
+  //Data written by one process has to be read back by the next one
+  test_persistence(&err_no, MAX_WRITE_BYTE);
+
+  printf("\n-------------------------------\nDifficult test Finished.\nCurrent Error Num: %d\n--------------------------------\n\n", err_no);
+
+  free(file_size);
+  for(int i = 0; i < MAX_FD; i++){
+    free(write_buf[i]);
+  }
+  free(write_buf);
+  free(write_ptr);
+  for(int i = 0; i < num_file; i++){
+    free(file_names[i]);
+  }
+  free(file_id);
+  free(file_names);
+  return 0;
+}
+
+/* The main testing program
+ */
+int main(void){
+  difficult_test();
+  return 0;
+}
@@ -0,0 +1,835 @@
+#include <pthread.h>
+#include "tests.h"
+/*
+Count the entries of a directory, how many of them are directories and whether one is named want
+*/
+int count_entries(char *path, char *want, int *dirs, int *found){
+  int cursor = 0;
+  int count = 0;
+  char name[maxNameLength + 2];
+
+  *dirs = 0;
+  *found = 0;
+  while(ssfs_readdir(path, &cursor, name) == 1){
+    count++;
+    if(name[strlen(name) - 1] == '/')
+      *dirs += 1;
+    if(want != NULL && strcmp(name, want) == 0)
+      *found = 1;
+  }
+  return count;
+}
+
+/*
+Directories nest, list their entries, refuse to go while they hold any and survive a remount.
+*/
+int test_directories(int *err_no){
+  int length = strlen(test_str);
+  char *read_buf = calloc(length, sizeof(char));
+  int file_id, dirs, found;
+  int cursor = 0;
+  char name[maxNameLength + 2];
+
+  printf("Checking Directories ... \n");
+  mkssfs(1);
+  if(ssfs_mkdir("d") < 0 || ssfs_mkdir("d/e") < 0){
+    fprintf(stderr, "Error. Directory could not be made\n");
+    *err_no += 1;
+  }
+  if(ssfs_mkdir("d") != -1 || ssfs_mkdir("x/e") != -1){
+    fprintf(stderr, "Error. Directory made twice or in a missing parent\n");
+    *err_no += 1;
+  }
+  file_id = ssfs_fopen("d/e/f");
+  if(file_id < 0 || ssfs_fwrite(file_id, test_str, length) != length){
+    fprintf(stderr, "Error. Nested file could not be written\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+  if(ssfs_fopen("d/e") != -1){
+    fprintf(stderr, "Error. Directory opened as a file\n");
+    *err_no += 1;
+  }
+  if(ssfs_rmdir("d") != -1){
+    fprintf(stderr, "Error. Directory holding entries removed\n");
+    *err_no += 1;
+  }
+
+  mkssfs(0);
+  file_id = ssfs_fopen("/d/e/f");
+  if(ssfs_fread(file_id, read_buf, length) != length || memcmp(read_buf, test_str, length) != 0){
+    fprintf(stderr, "Error. Nested file changed by the remount\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+  if(count_entries("d", "e/", &dirs, &found) != 1 || dirs != 1 || !found){
+    fprintf(stderr, "Error. Invalid listing of a directory\n");
+    *err_no += 1;
+  }
+  if(count_entries("/", "d/", &dirs, &found) != 1 || !found){
+    fprintf(stderr, "Error. Invalid listing of the root directory\n");
+    *err_no += 1;
+  }
+  if(ssfs_readdir("d/e/f", &cursor, name) != -1){
+    fprintf(stderr, "Error. File listed as a directory\n");
+    *err_no += 1;
+  }
+
+  if(ssfs_remove("d/e/f") < 0 || ssfs_rmdir("d/e") < 0 || ssfs_rmdir("d") < 0){
+    fprintf(stderr, "Error. Emptied directories could not be removed\n");
+    *err_no += 1;
+  }
+  mkssfs(0);
+  if(count_entries("/", NULL, &dirs, &found) != 0 || ssfs_fopen("d/e/f") != -1){
+    fprintf(stderr, "Error. Removed directories back after the remount\n");
+    *err_no += 1;
+  }
+
+  free(read_buf);
+  return 0;
+}
+
+/*
+Views of a file spanning several blocks show its bytes in order, stop at its end and survive a remount.
+*/
+int test_read_views(int *err_no){
+  int length = 3000;
+  int offset = 100;
+  char *write_buf = malloc(length);
+  char *read_buf = calloc(length, sizeof(char));
+  blockView_t views[8];
+  int file_id, count, read_length;
+
+  printf("Checking Read Views ... \n");
+  for(int i = 0; i < length; i++)
+    write_buf[i] = test_str[i % strlen(test_str)];
+  mkssfs(1);
+  file_id = ssfs_fopen("v");
+  ssfs_fwrite(file_id, write_buf, length);
+  ssfs_fclose(file_id);
+
+  for(int remount = 0; remount < 2; remount++){
+    if(remount)
+      mkssfs(0);
+    file_id = ssfs_fopen("v");
+    ssfs_frseek(file_id, offset);
+    count = ssfs_fread_views(file_id, length, views, 8);
+    read_length = 0;
+    for(int i = 0; i < count && read_length + views[i].length <= length; i++){
+      memcpy(read_buf + read_length, views[i].data, views[i].length);
+      read_length += views[i].length;
+    }
+    if(count < 2 || read_length != length - offset || memcmp(read_buf, write_buf + offset, read_length) != 0){
+      fprintf(stderr, "Error. Views don't match the file\n");
+      *err_no += 1;
+    }
+    ssfs_release_views(views, count > 0 ? count : 0);
+    if(ssfs_fread_views(file_id, length, views, 8) != 0){
+      fprintf(stderr, "Error. Views past the end of the file\n");
+      *err_no += 1;
+    }
+    ssfs_fclose(file_id);
+  }
+  ssfs_remove("v");
+
+  free(write_buf);
+  free(read_buf);
+  return 0;
+}
+
+/*
+A snapshot is listed, brings back the files it saw after a remount, stays after a rollback and goes when deleted.
+*/
+int test_snapshots(int *err_no){
+  int length = strlen(test_str);
+  char *read_buf = calloc(length, sizeof(char));
+  int ids[numberOfShadows];
+  int file_id, id, dirs, found;
+
+  printf("Checking Snapshots ... \n");
+  mkssfs(1);
+  file_id = ssfs_fopen("s");
+  ssfs_fwrite(file_id, test_str, length);
+  ssfs_fclose(file_id);
+  id = ssfs_snapshot();
+  if(id < 0 || ssfs_list_snapshots(ids) != 1 || ids[0] != id){
+    fprintf(stderr, "Error. Snapshot not listed\n");
+    *err_no += 1;
+  }
+
+  //Changes made after the snapshot
+  file_id = ssfs_fopen("s");
+  ssfs_fwseek(file_id, 0);
+  ssfs_fwrite(file_id, "changed", 7);
+  ssfs_fclose(file_id);
+  file_id = ssfs_fopen("t");
+  ssfs_fwrite(file_id, test_str, length);
+  ssfs_fclose(file_id);
+
+  mkssfs(0);
+  if(ssfs_list_snapshots(ids) != 1 || ssfs_rollback(id) < 0){
+    fprintf(stderr, "Error. Snapshot lost by the remount\n");
+    *err_no += 1;
+  }
+  mkssfs(0);
+  file_id = ssfs_fopen("s");
+  if(ssfs_fread(file_id, read_buf, length) != length || memcmp(read_buf, test_str, length) != 0){
+    fprintf(stderr, "Error. Rollback didn't bring back the file\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+  if(count_entries("/", "t", &dirs, &found) != 1 || found){
+    fprintf(stderr, "Error. File made after the snapshot kept by the rollback\n");
+    *err_no += 1;
+  }
+
+  if(ssfs_list_snapshots(ids) != 1 || ssfs_delete_snapshot(id) < 0){
+    fprintf(stderr, "Error. Snapshot not kept by the rollback\n");
+    *err_no += 1;
+  }
+  mkssfs(0);
+  if(ssfs_list_snapshots(ids) != 0 || ssfs_rollback(id) != -1){
+    fprintf(stderr, "Error. Deleted snapshot back after the remount\n");
+    *err_no += 1;
+  }
+  ssfs_remove("s");
+
+  free(read_buf);
+  return 0;
+}
+
+/*
+Two snapshots share the i-node file and the root directory, a rollback to one changes the blocks the other still shares.
+*/
+int test_snapshot_sharing(int *err_no){
+  char read_buf[8];
+  int file_id, first, second, dirs, found;
+
+  printf("Checking Snapshots sharing the i-node file ... \n");
+  mkssfs(1);
+  file_id = ssfs_fopen("p");
+  ssfs_fwrite(file_id, "first", 5);
+  ssfs_fclose(file_id);
+  first = ssfs_snapshot();
+
+  file_id = ssfs_fopen("p");
+  ssfs_fwseek(file_id, 0);
+  ssfs_fwrite(file_id, "second", 6);
+  ssfs_fclose(file_id);
+  file_id = ssfs_fopen("q");
+  ssfs_fwrite(file_id, "q", 1);
+  ssfs_fclose(file_id);
+  second = ssfs_snapshot();
+
+  file_id = ssfs_fopen("r");
+  ssfs_fwrite(file_id, "r", 1);
+  ssfs_fclose(file_id);
+  if(first < 0 || second < 0 || ssfs_rollback(first) < 0){
+    fprintf(stderr, "Error. Rollback to the first of two snapshots failed\n");
+    *err_no += 1;
+  }
+  mkssfs(0);
+  file_id = ssfs_fopen("p");
+  memset(read_buf, 0, sizeof(read_buf));
+  if(ssfs_fread(file_id, read_buf, 5) != 5 || strcmp(read_buf, "first") != 0 || count_entries("/", "q", &dirs, &found) != 1 || found){
+    fprintf(stderr, "Error. Rollback didn't bring back the first snapshot\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+
+  if(ssfs_rollback(second) < 0){
+    fprintf(stderr, "Error. Rollback to the second snapshot failed\n");
+    *err_no += 1;
+  }
+  mkssfs(0);
+  file_id = ssfs_fopen("p");
+  memset(read_buf, 0, sizeof(read_buf));
+  if(ssfs_fread(file_id, read_buf, 6) != 6 || strcmp(read_buf, "second") != 0 || count_entries("/", "q", &dirs, &found) != 2
+     || !found || count_entries("/", "r", &dirs, &found) != 2 || found){
+    fprintf(stderr, "Error. Rollback to the first snapshot changed the second\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+
+  ssfs_delete_snapshot(first);
+  ssfs_delete_snapshot(second);
+  ssfs_remove("p");
+  ssfs_remove("q");
+  return 0;
+}
+
+#define concurrentWriters 4
+#define concurrentWrites 40
+#define concurrentLength 300
+
+/*
+Content written by a thread of the concurrency test at one of its writes
+*/
+void fill_thread(char *buf, int thread, int write){
+  for(int i = 0; i < concurrentLength; i++)
+    buf[i] = test_str[(thread * 31 + write * 7 + i) % strlen(test_str)];
+}
+
+/*
+Write a file of its own then read it back, arg points to the thread number and is set to its error count
+*/
+void *concurrent_writer(void *arg){
+  int thread = *(int *)arg;
+  char write_buf[concurrentLength];
+  char read_buf[concurrentLength];
+  char name[maxNameLength + 1];
+  int file_id, errors = 0;
+
+  sprintf(name, "c%d", thread);
+  file_id = ssfs_fopen(name);
+  for(int k = 0; k < concurrentWrites; k++){
+    fill_thread(write_buf, thread, k);
+    if(ssfs_fwrite(file_id, write_buf, concurrentLength) != concurrentLength)
+      errors++;
+  }
+  for(int k = 0; k < concurrentWrites; k++){
+    fill_thread(write_buf, thread, k);
+    if(ssfs_fread(file_id, read_buf, concurrentLength) != concurrentLength || memcmp(read_buf, write_buf, concurrentLength) != 0)
+      errors++;
+  }
+  if(ssfs_fclose(file_id) < 0)
+    errors++;
+  *(int *)arg = errors;
+  return NULL;
+}
+
+/*
+Take and drop snapshots while the writers run, the last one is kept
+*/
+void *concurrent_snapshots(void *arg){
+  int id = -1;
+
+  for(int k = 0; k < 20; k++){
+    if(id >= 0)
+      ssfs_delete_snapshot(id);
+    id = ssfs_snapshot();
+  }
+  *(int *)arg = id;
+  return NULL;
+}
+
+/*
+Threads create, write and read files of their own while another one takes snapshots,
+every file reads back whole after a remount.
+*/
+int test_concurrency(int *err_no){
+  pthread_t writers[concurrentWriters];
+  pthread_t snapshots;
+  int results[concurrentWriters];
+  char write_buf[concurrentLength];
+  char read_buf[concurrentLength];
+  char name[maxNameLength + 1];
+  int ids[numberOfShadows];
+  int file_id, id;
+
+  printf("Checking Concurrent Calls ... \n");
+  mkssfs(1);
+  for(int i = 0; i < concurrentWriters; i++){
+    results[i] = i;
+    pthread_create(&writers[i], NULL, concurrent_writer, &results[i]);
+  }
+  pthread_create(&snapshots, NULL, concurrent_snapshots, &id);
+  for(int i = 0; i < concurrentWriters; i++){
+    pthread_join(writers[i], NULL);
+    if(results[i] != 0){
+      fprintf(stderr, "Error. Thread %d failed %d calls\n", i, results[i]);
+      *err_no += 1;
+    }
+  }
+  pthread_join(snapshots, NULL);
+  ssfs_sync();
+
+  mkssfs(0);
+  if(id < 0 || ssfs_list_snapshots(ids) != 1 || ids[0] != id){
+    fprintf(stderr, "Error. Snapshots taken alongside the writers not kept\n");
+    *err_no += 1;
+  }
+  for(int i = 0; i < concurrentWriters; i++){
+    sprintf(name, "c%d", i);
+    file_id = ssfs_fopen(name);
+    if(ssfs_fsize(file_id) != concurrentWrites * concurrentLength){
+      fprintf(stderr, "Error. File of thread %d lost writes\n", i);
+      *err_no += 1;
+    }
+    for(int k = 0; k < concurrentWrites; k++){
+      fill_thread(write_buf, i, k);
+      if(ssfs_fread(file_id, read_buf, concurrentLength) != concurrentLength || memcmp(read_buf, write_buf, concurrentLength) != 0){
+        fprintf(stderr, "Error. File of thread %d changed by the remount\n", i);
+        *err_no += 1;
+        break;
+      }
+    }
+    ssfs_fclose(file_id);
+  }
+  if(id >= 0)
+    ssfs_delete_snapshot(id);
+
+  return 0;
+}
+
+/*
+A batch applies each operation in order, reports the ones that fail without stopping and is durable when it returns.
+*/
+int test_batch(int *err_no){
+  batchOp_t ops[6];
+  int expected[6] = {0, 0, 0, -1, 0, -1};
+  char *paths[6] = {"b", "b/x", "y", "y", "y", "nope"};
+  int types[6] = {batchMkdir, batchCreate, batchCreate, batchCreate, batchRemove, batchRemove};
+  int dirs, found;
+
+  printf("Checking Batches ... \n");
+  mkssfs(1);
+  for(int i = 0; i < 6; i++){
+    ops[i].type = types[i];
+    ops[i].path = paths[i];
+  }
+  if(ssfs_batch(ops, 6) != 4){
+    fprintf(stderr, "Error. Invalid number of operations done\n");
+    *err_no += 1;
+  }
+  for(int i = 0; i < 6; i++){
+    if(ops[i].result != expected[i]){
+      fprintf(stderr, "Error. Invalid result for operation %d of the batch\n", i);
+      *err_no += 1;
+    }
+  }
+
+  mkssfs(0);
+  if(count_entries("/", "b/", &dirs, &found) != 1 || !found || count_entries("b", "x", &dirs, &found) != 1 || !found){
+    fprintf(stderr, "Error. Batch lost by the remount\n");
+    *err_no += 1;
+  }
+  ops[0].type = batchRemove;
+  ops[0].path = "b/x";
+  if(ssfs_batch(ops, 1) != 1 || ssfs_rmdir("b") < 0){
+    fprintf(stderr, "Error. Batch could not remove\n");
+    *err_no += 1;
+  }
+  return 0;
+}
+
+/*
+A file small enough to stay in its i-node reads back, gives a view and moves to a block when it grows, across remounts.
+*/
+int test_inline_spill(int *err_no){
+  int small = inlineDataSize / 2;
+  int length = small + strlen(test_str);
+  char *write_buf = malloc(length);
+  char *read_buf = calloc(length, sizeof(char));
+  blockView_t views[1];
+  int file_id, count;
+
+  printf("Checking Small Files ... \n");
+  memcpy(write_buf, test_str + 10, small);
+  memcpy(write_buf + small, test_str, strlen(test_str));
+  mkssfs(1);
+  file_id = ssfs_fopen("i");
+  ssfs_fwrite(file_id, write_buf, small);
+  ssfs_fclose(file_id);
+
+  mkssfs(0);
+  file_id = ssfs_fopen("i");
+  count = ssfs_fread_views(file_id, small, views, 1);
+  if(count != 1 || views[0].length != small || memcmp(views[0].data, write_buf, small) != 0){
+    fprintf(stderr, "Error. Invalid view of a small file\n");
+    *err_no += 1;
+  }
+  ssfs_release_views(views, count > 0 ? count : 0);
+
+  //Past the room in the i-node
+  ssfs_fwseek(file_id, small);
+  if(ssfs_fwrite(file_id, write_buf + small, length - small) != length - small){
+    fprintf(stderr, "Error. Small file could not grow\n");
+    *err_no += 1;
+  }
+  ssfs_frseek(file_id, 0);
+  if(ssfs_fread(file_id, read_buf, length) != length || memcmp(read_buf, write_buf, length) != 0){
+    fprintf(stderr, "Error. Small file changed by growing\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+
+  mkssfs(0);
+  memset(read_buf, 0, length);
+  file_id = ssfs_fopen("i");
+  if(ssfs_fread(file_id, read_buf, length) != length || memcmp(read_buf, write_buf, length) != 0){
+    fprintf(stderr, "Error. Grown file changed by the remount\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+  ssfs_remove("i");
+
+  free(write_buf);
+  free(read_buf);
+  return 0;
+}
+
+/*
+A disk formatted with its own block size and i-node count holds more files than the default one and survives a remount.
+*/
+int test_geometry(int *err_no){
+  int num_file = defaultNumberOfInodes + 50;
+  int length = 10000;
+  char *write_buf = malloc(length);
+  char *read_buf = calloc(length, sizeof(char));
+  char name[maxNameLength + 1];
+  int file_id;
+
+  printf("Checking Disk Geometry ... \n");
+  for(int i = 0; i < length; i++)
+    write_buf[i] = test_str[i % strlen(test_str)];
+  if(mkssfs_geometry(1000, 4096, 500) != -1 || mkssfs_geometry(4096, 16, 500) != -1){
+    fprintf(stderr, "Error. Invalid geometry accepted\n");
+    *err_no += 1;
+  }
+  if(mkssfs_geometry(4096, 4096, 2 * num_file) < 0){
+    fprintf(stderr, "Error. Geometry could not be formatted\n");
+    *err_no += 1;
+    free(write_buf);
+    free(read_buf);
+    return -1;
+  }
+  for(int i = 0; i < num_file; i++){
+    sprintf(name, "g%d", i);
+    file_id = ssfs_fopen(name);
+    if(file_id < 0 || ssfs_fwrite(file_id, write_buf, i == 0 ? length : 1) < 0){
+      fprintf(stderr, "Error. File %d could not be written\n", i);
+      *err_no += 1;
+      break;
+    }
+    ssfs_fclose(file_id);
+  }
+
+  mkssfs(0);
+  file_id = ssfs_fopen("g0");
+  if(ssfs_fread(file_id, read_buf, length) != length || memcmp(read_buf, write_buf, length) != 0){
+    fprintf(stderr, "Error. File changed by the remount of its geometry\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+  sprintf(name, "g%d", num_file - 1);
+  file_id = ssfs_fopen(name);
+  if(ssfs_fsize(file_id) != 1){
+    fprintf(stderr, "Error. Last file lost by the remount of its geometry\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+
+  free(write_buf);
+  free(read_buf);
+  return 0;
+}
+
+/*
+Fill buf with the content expected at offset of the large test file
+*/
+void fill_at(char *buf, long long offset, int length){
+  for(int i = 0; i < length; i++)
+    buf[i] = test_str[((offset + i) / 13) % strlen(test_str)];
+}
+
+/*
+A file grows past the blocks its double indirect pointer reaches, a write at a seek beyond them goes through
+the triple indirect pointer, and the size and content survive a remount.
+*/
+int test_triple_indirect(int *err_no){
+  int block_size = minBlockSize;
+  long long pointers = block_size / sizeOfPointer;
+  long long reach = (numberOfDirect + pointers + pointers * pointers) * block_size;
+  long long size = reach + 4 * block_size;
+  long long tail = reach + block_size + 7;
+  int chunk = 64 * block_size;
+  int length = 1000;
+  char *write_buf = malloc(chunk);
+  char *read_buf = calloc(chunk, sizeof(char));
+  char *tail_buf = malloc(length);
+  long long done = 0;
+  int file_id, count;
+
+  printf("Checking Triple Indirect Blocks ... \n");
+  for(int i = 0; i < length; i++)
+    tail_buf[i] = test_str[(i * 3) % strlen(test_str)];
+  if(mkssfs_geometry(block_size, 20000, 16) < 0){
+    fprintf(stderr, "Error. Geometry could not be formatted\n");
+    *err_no += 1;
+    free(write_buf);
+    free(read_buf);
+    free(tail_buf);
+    return -1;
+  }
+  file_id = ssfs_fopen("t");
+  //Fill up to a few blocks past the double indirect blocks
+  while(done < size){
+    count = size - done < chunk ? size - done : chunk;
+    fill_at(write_buf, done, count);
+    if(ssfs_fwrite(file_id, write_buf, count) != count){
+      fprintf(stderr, "Error. Could not write at %lld\n", done);
+      *err_no += 1;
+      break;
+    }
+    done += count;
+  }
+  if(ssfs_fwseek(file_id, tail) < 0 || ssfs_fwrite(file_id, tail_buf, length) != length){
+    fprintf(stderr, "Error. Could not write past the double indirect blocks\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+
+  mkssfs(0);
+  file_id = ssfs_fopen("t");
+  if(ssfs_fsize(file_id) != size){
+    fprintf(stderr, "Error. Size %lld instead of %lld after the remount\n", ssfs_fsize(file_id), size);
+    *err_no += 1;
+  }
+  //Last blocks of the double indirect blocks, then every block of the triple indirect ones
+  fill_at(write_buf, reach - chunk, chunk);
+  if(ssfs_frseek(file_id, reach - chunk) < 0 || ssfs_fread(file_id, read_buf, chunk) != chunk || memcmp(read_buf, write_buf, chunk) != 0){
+    fprintf(stderr, "Error. Data before the triple indirect blocks changed\n");
+    *err_no += 1;
+  }
+  fill_at(write_buf, reach, size - reach);
+  memcpy(write_buf + (tail - reach), tail_buf, length);
+  if(ssfs_fread(file_id, read_buf, chunk) != size - reach || memcmp(read_buf, write_buf, size - reach) != 0){
+    fprintf(stderr, "Error. Data past the double indirect blocks changed\n");
+    *err_no += 1;
+  }
+  ssfs_fclose(file_id);
+
+  free(write_buf);
+  free(read_buf);
+  free(tail_buf);
+  return 0;
+}
+
+/*
+Files written through either disk backend read back after a remount with the same one and with the other one.
+*/
+int test_backends(int *err_no){
+  int backends[2] = {DISK_BACKEND_FILE, DISK_BACKEND_MMAP};
+  int length = 5000;
+  char *write_buf = malloc(length);
+  char *read_buf = calloc(length, sizeof(char));
+  int file_id;
+
+  printf("Checking Disk Backends ... \n");
+  for(int i = 0; i < length; i++)
+    write_buf[i] = test_str[(i * 7) % strlen(test_str)];
+  if(ssfs_disk_backend(-1) != -1){
+    fprintf(stderr, "Error. Invalid backend accepted\n");
+    *err_no += 1;
+  }
+  for(int i = 0; i < 2; i++){
+    ssfs_disk_backend(backends[i]);
+    mkssfs(1);
+    file_id = ssfs_fopen("k");
+    ssfs_fwrite(file_id, write_buf, length);
+    ssfs_fclose(file_id);
+
+    for(int j = 0; j < 2; j++){
+      ssfs_disk_backend(backends[(i + j) % 2]);
+      mkssfs(0);
+      memset(read_buf, 0, length);
+      file_id = ssfs_fopen("k");
+      if(ssfs_fread(file_id, read_buf, length) != length || memcmp(read_buf, write_buf, length) != 0){
+        fprintf(stderr, "Error. File written with backend %d changed when mounted with backend %d\n", backends[i], backends[(i + j) % 2]);
+        *err_no += 1;
+      }
+      ssfs_fclose(file_id);
+    }
+  }
+  ssfs_disk_backend(defaultDiskBackend);
+
+  free(write_buf);
+  free(read_buf);
+  return 0;
+}
+
+/*
+Reads and writes of the emulated disk are counted and timed by the device model, and come back as -1
+once the injected failures outlast the retries.
+*/
+int test_device_model(int *err_no){
+  int block_size = 512;
+  char *write_buf = malloc(4 * block_size);
+  char *read_buf = calloc(4 * block_size, sizeof(char));
+  disk_model_t model, saved;
+  disk_stats_t stats;
+
+  printf("Checking Device Model ... \n");
+  for(int i = 0; i < 4 * block_size; i++)
+    write_buf[i] = test_str[i % strlen(test_str)];
+  get_disk_model(&saved);
+  memset(&model, 0, sizeof(model));
+  model.latency = 10;
+  model.seek_cost = 1;
+  set_disk_model(&model);
+  init_fresh_disk("DEVICE", block_size, 16);
+  reset_disk_stats();
+
+  if(write_blocks(8, 4, write_buf) != 4 || read_blocks(8, 4, read_buf) != 4 || memcmp(read_buf, write_buf, 4 * block_size) != 0){
+    fprintf(stderr, "Error. Read doesn't match the write\n");
+    *err_no += 1;
+  }
+  get_disk_stats(&stats);
+  //The head starts at block 0, goes to 8 then back from 12 to 8
+  if(stats.writes != 1 || stats.blocks_written != 4 || stats.reads != 1 || stats.blocks_read != 4
+     || stats.seeks != 2 || stats.seek_distance != 12 || stats.simulated_time != 2 * model.latency + 12 * model.seek_cost){
+    fprintf(stderr, "Error. Invalid device counters\n");
+    *err_no += 1;
+  }
+
+  //Every attempt fails, the retries run out
+  model.failure = 1;
+  model.max_retry = 2;
+  set_disk_model(&model);
+  reset_disk_stats();
+  if(write_blocks(0, 1, write_buf) != -1 || read_blocks(0, 1, read_buf) != -1){
+    fprintf(stderr, "Error. Injected failure not returned\n");
+    *err_no += 1;
+  }
+  get_disk_stats(&stats);
+  if(stats.failures != 2 || stats.retries != 4){
+    fprintf(stderr, "Error. Invalid failure counters\n");
+    *err_no += 1;
+  }
+
+  set_disk_model(&saved);
+  close_disk();
+  remove("DEVICE");
+  free(write_buf);
+  free(read_buf);
+  return 0;
+}
+
+/*
+Completion callback of the async test, keeps the result of each request
+*/
+void record_result(int handle, int result, void *arg){
+  *(int *)arg = result;
+}
+
+/*
+Requests queued on the disk workers complete with what the blocking calls would have returned,
+through the callback, poll and wait, and a failed one completes with -1.
+*/
+int test_async_io(int *err_no){
+  int block_size = 512;
+  char *write_buf = malloc(4 * block_size);
+  char *read_buf = calloc(4 * block_size, sizeof(char));
+  int blocks[2] = {9, 5};
+  void *buffers[2] = {write_buf, write_buf + block_size};
+  int handle, result = 0, done = 0;
+  disk_model_t model, saved;
+  disk_stats_t stats;
+
+  printf("Checking Async Disk Requests ... \n");
+  for(int i = 0; i < 4 * block_size; i++)
+    write_buf[i] = test_str[(i / 7) % strlen(test_str)];
+  get_disk_model(&saved);
+  memset(&model, 0, sizeof(model));
+  model.latency = 10;
+  set_disk_model(&model);
+  init_fresh_disk("ASYNC", block_size, 16);
+  reset_disk_stats();
+
+  handle = submit_write_blocks(0, 4, write_buf, NULL, NULL);
+  if(wait_disk_request(handle) != 4){
+    fprintf(stderr, "Error. Queued write did not complete\n");
+    *err_no += 1;
+  }
+  handle = submit_read_blocks(0, 4, read_buf, NULL, NULL);
+  while(!done)
+    done = poll_disk_request(handle);
+  if(done < 0 || wait_disk_request(handle) != 4 || memcmp(read_buf, write_buf, 4 * block_size) != 0){
+    fprintf(stderr, "Error. Queued read doesn't match the write\n");
+    *err_no += 1;
+  }
+
+  //Scattered list of two runs, the result comes back through the callback
+  submit_write_block_list(2, blocks, buffers, record_result, &result);
+  wait_all_disk_requests();
+  if(result != 2 || read_blocks(5, 1, read_buf) != 1 || memcmp(read_buf, write_buf + block_size, block_size) != 0){
+    fprintf(stderr, "Error. Queued block list not written\n");
+    *err_no += 1;
+  }
+  get_disk_stats(&stats);
+  if(stats.writes != 3 || stats.blocks_written != 6 || stats.reads != 2 || stats.blocks_read != 5
+     || stats.simulated_time < 4 * model.latency || stats.failures != 0){
+    fprintf(stderr, "Error. Invalid counters of the queued requests\n");
+    *err_no += 1;
+  }
+
+  //A failed request completes with -1, through wait and through the callback
+  model.failure = 1;
+  set_disk_model(&model);
+  result = 0;
+  handle = submit_write_blocks(0, 1, write_buf, NULL, NULL);
+  submit_read_blocks(0, 1, read_buf, record_result, &result);
+  if(wait_disk_request(handle) != -1 || wait_all_disk_requests() != 0 || result != -1){
+    fprintf(stderr, "Error. Queued failure not returned\n");
+    *err_no += 1;
+  }
+
+  set_disk_model(&saved);
+  close_disk();
+  remove("ASYNC");
+  free(write_buf);
+  free(read_buf);
+  return 0;
+}
+
+/*
+Testing of the calls beyond the assignment interface, each one checked again after a remount.
+For all tests, -1 is considered error and 0 is considered success.
+*/
+int feature_test(){
+  printf("\n-------------------------------\nInitializing Feature test.\n--------------------------------\n\n");
+  int err_no = 0;
+
+  //Nested directories, listing and removal
+  test_directories(&err_no);
+
+  //Reads without a copy, from the block cache
+  test_read_views(&err_no);
+
+  //Snapshots taken, rolled back to and deleted
+  test_snapshots(&err_no);
+  //Snapshots sharing the i-node file and root directory blocks until they change
+  test_snapshot_sharing(&err_no);
+  //Files written by several threads while snapshots are taken
+  test_concurrency(&err_no);
+
+  //Creates, removes and mkdirs in one commit
+  test_batch(&err_no);
+
+  //Files kept in their i-node until they grow
+  test_inline_spill(&err_no);
+
+  //A disk formatted with a chosen geometry
+  test_geometry(&err_no);
+  //Blocks behind the triple indirect pointer
+  test_triple_indirect(&err_no);
+
+  //Both disk backends, and a disk mounted with the other one
+  test_backends(&err_no);
+
+  //Emulated disk on its own : counters, timing and failures
+  test_device_model(&err_no);
+  //Emulated disk on its own : queued requests
+  test_async_io(&err_no);
+
+  printf("\n-------------------------------\nFeature test Finished.\nCurrent Error Num: %d\n--------------------------------\n\n", err_no);
+  return 0;
+}
+
+/* The main testing program
+ */
+int main(void){
+  feature_test();
+  return 0;
+}